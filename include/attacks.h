@@ -7,5 +7,8 @@ void init_attacks();
 Bitboard get_attacks(const Board *board, int square, int piece);
 bool is_attacked(const Board *board, int square, int player);
 bool in_check(const Board *board, int player);
+Bitboard get_between(int start, int end);
+int see(const Board *board, Move move);
+bool see_ge(const Board *board, Move move, int threshold);
 
 #endif
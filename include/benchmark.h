@@ -4,6 +4,7 @@
 #include "types.h"
 
 void benchmark(Board *board, int depth);
+void search_benchmark(int depth);
 void perft(Board *board, int depth, U64 *nodes);
 
 #endif
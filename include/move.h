@@ -5,6 +5,7 @@
 
 void print_move(Move move);
 void make_move(Board *board, Move move);
+U64 key_after(const Board *board, Move move);
 void unmake_move(Board *board, Move move);
 void make_null_move(Board *board);
 void unmake_null_move(Board *board);
@@ -4,7 +4,10 @@
 #include "types.h"
 
 int generate_moves(const Board *board, Move *moves);
+int generate_captures(const Board *board, Move *moves);
+int generate_quiets(const Board *board, Move *moves);
 int generate_quiescence_moves(const Board *board, Move *moves);
 int generate_legal_moves(Board *board, Move *moves);
+bool move_pseudo_legal(const Board *board, Move move);
 
 #endif
@@ -8,22 +8,49 @@ typedef struct moveList {
     int score;
 } MoveList;
 
+// Generate and select moves lazily in stages of the move ordering
+typedef struct movePicker {
+    MoveList moves[MAX_MOVES];
+    Move tt_move;
+    Move killer_moves[2];
+    Move counter_move;
+    int stage;
+    int index;
+    int count;
+    int bad_count;
+} MovePicker;
+
+enum Stage {
+    TT_STAGE,
+    CAPTURES_INIT_STAGE,
+    GOOD_CAPTURES_STAGE,
+    KILLER1_STAGE,
+    KILLER2_STAGE,
+    COUNTER_STAGE,
+    BAD_CAPTURES_STAGE,
+    QUIETS_INIT_STAGE,
+    QUIETS_STAGE,
+    DONE_STAGE,
+    ROOT_STAGE,
+};
+
 /*
     Move Ordering
 
     1. Transposition table move
-    2. Winning captures with MVV/LVA
-    3. Equal captures
-    4. Killer moves
-    5. Losing captures
-    6. Quiet moves
+    2. Captures that do not lose material by SEE with MVV/LVA
+    3. Killer moves
+    4. Counter move
+    5. Captures that lose material by SEE
+    6. Quiet moves by history heuristics
 */
 enum MoveValue {
-    TT_MOVE = 100,
-    WINNING_CAPTURE = 80,
-    EQUAL_CAPTURE = 60,
-    KILLER_MOVE = 40,
-    LOSING_CAPTURE = 20,
+    TT_MOVE = 1000000,
+    WINNING_CAPTURE = 800000,
+    EQUAL_CAPTURE = 600000,
+    KILLER_MOVE = 400000,
+    COUNTER_MOVE = 300000,
+    LOSING_CAPTURE = 200000,
     QUIET_MOVE = 0,
 };
 
@@ -60,10 +87,15 @@ enum MVV_LVA {
     PxQ,
 };
 
-void score_moves(Board *board, Stack *stack, Move *moves, MoveList *move_list,
-                 Move tt_move, int length);
+void init_move_picker(MovePicker *picker, Thread *thread, Stack *stack,
+                      Move tt_move);
+Move next_move(MovePicker *picker, Thread *thread, Stack *stack);
 void score_quiescence_moves(Board *board, Move *moves, MoveList *move_list,
-                            int length);
+                            int length, Move tt_move);
 Move sort_moves(MoveList *move_list, int length, int index);
+void update_history(Thread *thread, Stack *stack, Move best_move,
+                    Move *quiet_moves, int quiet_count, int depth);
+void age_history(Thread *thread);
+void clear_history(Thread *thread);
 
 #endif
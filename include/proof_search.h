@@ -0,0 +1,13 @@
+#ifndef PROOF_SEARCH_H
+#define PROOF_SEARCH_H
+
+#include "search.h"
+
+extern bool use_proof_search;
+
+bool start_proof_search(Board *board, Parameter parameters);
+void reset_proof_search();
+void stop_proof_search();
+void free_proof_search();
+
+#endif
@@ -3,6 +3,6 @@
 
 #include "types.h"
 
-int quiescence_search(Board *board, int alpha, int beta);
+int quiescence_search(Thread *thread, int alpha, int beta, int ply);
 
 #endif
@@ -15,12 +15,39 @@ typedef struct parameter {
     U64 black_increment;
     int moves_to_go;
     int max_depth;
-    int max_nodes;
+    U64 max_nodes;
     int mate;
     bool ponder;
     bool infinite;
+    bool silent;
 } Parameter;
 
+// Search techniques that can be disabled to measure their effect
+typedef struct features {
+    bool aspiration;
+    bool reductions;
+    bool reverse_futility;
+    bool razoring;
+    bool futility;
+    bool late_move_pruning;
+    bool history;
+    bool see_pruning;
+    bool internal_reduction;
+    bool singular_extension;
+    bool upcoming_repetition;
+} Features;
+
+extern Features features;
+extern int multi_pv;
+
+void init_search();
+void init_threads(int count);
+void free_threads();
 void start_search(Board *board, Parameter parameters);
+void clear_search();
+void reset_search();
+void stop_search();
+Info get_search_info();
+void print_tt_stats();
 
 #endif
@@ -0,0 +1,27 @@
+#ifndef TABLEBASE_H
+#define TABLEBASE_H
+
+#include "types.h"
+
+#define TABLEBASE_PIECES 4
+
+// Score of a won tablebase position, below mate scores since the distance
+// to mate is unknown when only the win/draw/loss table is probed
+#define TABLEBASE_SCORE (INFINITY - 2 * MAX_PLY)
+
+enum WDL {
+    WDL_LOSS = -1,
+    WDL_DRAW,
+    WDL_WIN,
+};
+
+extern int tablebase_pieces;
+
+void init_tablebases(const char *path);
+void free_tablebases();
+bool probe_wdl(const Board *board, int *wdl);
+bool probe_dtm(const Board *board, int *score);
+bool probe_root(Board *board, RootMove *root_moves, int count);
+void generate_tablebases(const char *path, int pieces);
+
+#endif
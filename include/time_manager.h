@@ -0,0 +1,16 @@
+#ifndef TIME_MANAGER_H
+#define TIME_MANAGER_H
+
+#include "search.h"
+
+extern int move_overhead;
+
+void init_time_manager(const Parameter *parameters, int player);
+bool stop_iterating(int stability);
+bool time_over();
+bool optimum_time_over(double share);
+void set_pondering(bool ponder);
+void ponder_hit();
+bool is_pondering();
+
+#endif
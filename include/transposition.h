@@ -3,15 +3,14 @@
 
 #include "types.h"
 
-// Transposition table entry
+// Transposition table entry, the flag holds the bound in the lower 2 bits
+// and the generation above them
 typedef struct transposition {
-    U64 hash;
     Move move;
     int16_t score;
-    uint8_t age;
+    int16_t eval;
     uint8_t depth;
     uint8_t flag;
-    bool pv_node;
 } Transposition;
 
 enum Bound {
@@ -21,16 +20,24 @@ enum Bound {
     UPPER_BOUND,
 };
 
+void init_hash_keys();
 void init_transposition(int megabytes);
 void clear_transposition();
+void wait_transposition();
 void free_transposition();
+void age_transposition();
+bool save_transposition(const char *path);
+bool load_transposition(const char *path);
+void prefetch_transposition(U64 hash);
 int get_transposition(U64 hash, int alpha, int beta, int ply, int depth,
-                      Move *move);
-void set_transposition(U64 hash, int score, int flag, int ply, int depth,
-                       Move move);
-void set_pv_moves(Board *board, Stack *stack, int score);
+                      Move *move, int *eval, TTStats *stats);
+bool probe_transposition(U64 hash, int ply, Transposition *entry);
+void set_transposition(U64 hash, int score, int eval, int flag, int ply,
+                       int depth, Move move, TTStats *stats);
+void set_pv_moves(Board *board, Move *pv_moves, int length, int score);
 void get_pv_moves(Board *board);
 U64 get_hash(Board *board);
 int get_hashfull();
+Move get_cuckoo_move(U64 key);
 
 #endif
@@ -3,6 +3,7 @@
 
 #include <ctype.h>
 #include <inttypes.h>
+#include <math.h>
 #include <pthread.h>
 #include <signal.h>
 #include <stdbool.h>
@@ -21,10 +22,13 @@
 #define MAX_GAME_LENGTH 1024
 
 #define DRAW_SCORE 0
+// Replaces the floating point INFINITY of math.h, which is not used
+#undef INFINITY
 #define INFINITY 30000
 #define INVALID_SCORE 32767
 
 #define NULL_MOVE 0
+#define MAX_HISTORY 16384
 
 #define CASTLE_WK 1
 #define CASTLE_WQ 2
@@ -86,22 +90,76 @@ typedef struct board {
 
 // Information about each ply in a search
 typedef struct stack {
+    int16_t (*continuation)[64];
     Move killer_moves[2];
     Move pv_moves[MAX_PLY + 1];
+    Move excluded_move;
+    Move move;
+    int piece;
     int pv_length;
     int ply;
     bool null_move;
 } Stack;
 
+// Transposition table stats, collisions are entries of another position
+// with the same key found by their move not being pseudo legal
+typedef struct ttStats {
+    U64 probes;
+    U64 hits;
+    U64 depth_hits;
+    U64 cutoffs;
+    U64 replacements;
+    U64 collisions;
+} TTStats;
+
 // Search stats
 typedef struct info {
+    int depth;
     int seldepth;
     U64 nodes;
+    U64 quiescence_nodes;
+    U64 reductions;
+    U64 researches;
+    U64 tbhits;
+    TTStats tt;
 } Info;
 
-extern Info info;
+// Legal move at the root with its own score and principal variation
+typedef struct rootMove {
+    Move move;
+    int score;
+    int previous_score;
+    U64 nodes;
+    int pv_length;
+    Move pv_moves[MAX_PLY + 1];
+} RootMove;
+
+// Search thread with its own copy of the board and search stack
+typedef struct thread {
+    Board board;
+    Stack stack[MAX_PLY + 1];
+    Info info;
+
+    // Root moves are sorted by score, moves before pv index are excluded
+    RootMove root_moves[MAX_MOVES];
+    int root_count;
+    int pv_index;
+
+    // History heuristics indexed by side, start and end square, by piece and
+    // end square of the previous move, and by piece and end square of the
+    // move one and two plies ago followed by piece and end square
+    int16_t history[2][64][64];
+    Move counter_moves[16][64];
+    int16_t continuation[16][64][16][64];
+
+    pthread_t tid;
+    int id;
+    U64 check_nodes;
+    volatile bool stop;
+} Thread;
+
 extern int game_ply;
-extern bool time_over;
+extern bool debug_mode;
 
 // clang-format off
 enum Square {
@@ -182,7 +240,7 @@ static inline bool is_mate_score(int score) {
 }
 
 static inline int score_to_mate(int score) {
-    return (INFINITY - abs(score)) / 2;
+    return (INFINITY - abs(score) + 1) / 2;
 }
 
 // Move and piece functions
@@ -270,7 +328,7 @@ static inline U64 get_time() { return GetTickCount64(); }
 static inline U64 get_time() {
     struct timespec time;
     clock_gettime(CLOCK_MONOTONIC, &time);
-    return time.tv_sec * 1000 + time.tv_nsec / 10000000;
+    return time.tv_sec * 1000 + time.tv_nsec / 1000000;
 }
 
 #endif
@@ -16,6 +16,13 @@ static Magic rook_magics[64];
 static Magic bishop_magics[64];
 static Bitboard rook_attacks[102400];
 static Bitboard bishop_attacks[5248];
+static Bitboard between[64][64];
+
+static inline Bitboard get_attackers(const Board *board, int square,
+                                     Bitboard occupancy);
+static inline Bitboard get_least_valuable(const Board *board,
+                                          Bitboard attackers, int player,
+                                          int *piece);
 
 static Bitboard init_pawn_attacks(int square, int player);
 static Bitboard init_knight_attacks(int square);
@@ -41,8 +48,26 @@ void init_attacks() {
     // Find perfect hashing algorithm multiply number for rooks and bishops
     init_magics(ROOK);
     init_magics(BISHOP);
+
+    // Squares between two squares on the same line
+    for (int start = 0; start < 64; start++) {
+        for (int end = 0; end < 64; end++) {
+            if (get_rook_attacks(start, 0) & create_bit(end)) {
+                between[start][end] =
+                    get_rook_attacks(start, create_bit(end)) &
+                    get_rook_attacks(end, create_bit(start));
+            } else if (get_bishop_attacks(start, 0) & create_bit(end)) {
+                between[start][end] =
+                    get_bishop_attacks(start, create_bit(end)) &
+                    get_bishop_attacks(end, create_bit(start));
+            }
+        }
+    }
 }
 
+// Get squares between two squares on the same line, excluding both squares
+Bitboard get_between(int start, int end) { return between[start][end]; }
+
 // Get attack bitboard by piece on square excluding own color
 Bitboard get_attacks(const Board *board, int square, int piece) {
     switch (piece) {
@@ -86,6 +111,112 @@ bool in_check(const Board *board, int player) {
     return is_attacked(board, king, !player);
 }
 
+// Static exchange evaluation of the material won on the end square of a move
+int see(const Board *board, Move move) {
+    static const int values[6] = {100, 300, 300, 500, 900, 20000};
+
+    int start = get_move_start(move), end = get_move_end(move);
+    int flag = get_move_flag(move);
+    int piece = get_piece_type(board->board[start]);
+    int player = board->player;
+    int gain[32], depth = 0;
+
+    if (flag == CASTLING) {
+        return 0;
+    }
+
+    Bitboard occupancy = board->occupancies[2];
+    Bitboard from = create_bit(start);
+
+    // Value of the captured piece, and of the promotion
+    gain[0] = 0;
+    if (flag == ENPASSANT) {
+        gain[0] = values[PAWN];
+        clear_bit(&occupancy, make_square(end & 7, start >> 3));
+    } else if (board->board[end] != NO_PIECE) {
+        gain[0] = values[get_piece_type(board->board[end])];
+    }
+    if (flag == PROMOTION) {
+        piece = get_move_promotion(move) + KNIGHT;
+        gain[0] += values[piece] - values[PAWN];
+    }
+
+    Bitboard attackers = get_attackers(board, end, occupancy);
+
+    // Capture with the least valuable piece until one side runs out
+    do {
+        depth++;
+        player = !player;
+
+        // Speculative score if the piece on the square is captured
+        gain[depth] = values[piece] - gain[depth - 1];
+        if (MAX(-gain[depth - 1], gain[depth]) < 0) {
+            break;
+        }
+
+        // Remove attacker and add sliders that attack through it (x-rays)
+        occupancy ^= from;
+        attackers |= (get_bishop_attacks(end, occupancy) &
+                      (board->pieces[W_BISHOP] | board->pieces[B_BISHOP] |
+                       board->pieces[W_QUEEN] | board->pieces[B_QUEEN])) |
+                     (get_rook_attacks(end, occupancy) &
+                      (board->pieces[W_ROOK] | board->pieces[B_ROOK] |
+                       board->pieces[W_QUEEN] | board->pieces[B_QUEEN]));
+        attackers &= occupancy;
+
+        from = get_least_valuable(board, attackers, player, &piece);
+    } while (from);
+
+    // Each side can stop capturing if it would lose material
+    while (--depth) {
+        gain[depth - 1] = -MAX(-gain[depth - 1], gain[depth]);
+    }
+
+    return gain[0];
+}
+
+// Check if static exchange evaluation of a move is at least threshold
+bool see_ge(const Board *board, Move move, int threshold) {
+    return see(board, move) >= threshold;
+}
+
+// Get pieces of both colors attacking a square
+static inline Bitboard get_attackers(const Board *board, int square,
+                                     Bitboard occupancy) {
+    return (pawn_attacks[BLACK][square] & board->pieces[W_PAWN]) |
+           (pawn_attacks[WHITE][square] & board->pieces[B_PAWN]) |
+           (knight_attacks[square] &
+            (board->pieces[W_KNIGHT] | board->pieces[B_KNIGHT])) |
+           (king_attacks[square] &
+            (board->pieces[W_KING] | board->pieces[B_KING])) |
+           (get_bishop_attacks(square, occupancy) &
+            (board->pieces[W_BISHOP] | board->pieces[B_BISHOP] |
+             board->pieces[W_QUEEN] | board->pieces[B_QUEEN])) |
+           (get_rook_attacks(square, occupancy) &
+            (board->pieces[W_ROOK] | board->pieces[B_ROOK] |
+             board->pieces[W_QUEEN] | board->pieces[B_QUEEN]));
+}
+
+// Get least valuable attacker of player and save its piece type
+static inline Bitboard get_least_valuable(const Board *board,
+                                          Bitboard attackers, int player,
+                                          int *piece) {
+    for (int type = PAWN; type <= KING; type++) {
+        Bitboard pieces = attackers & board->pieces[make_piece(type, player)];
+        if (pieces) {
+            // King can not capture a defended piece
+            if (type == KING && (attackers & board->occupancies[!player])) {
+                return UINT64_C(0);
+            }
+
+            *piece = type;
+            return pieces & -pieces;
+        }
+    }
+
+    return UINT64_C(0);
+}
+
 // Initialize pawn attack lookup table
 static Bitboard init_pawn_attacks(int square, int player) {
     Bitboard pawn = create_bit(square);
@@ -4,6 +4,36 @@
 #include "board.h"
 #include "move.h"
 #include "move_generation.h"
+#include "search.h"
+#include "transposition.h"
+
+#define BENCH_POSITIONS 6
+
+static const char *bench_positions[BENCH_POSITIONS] = {
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 15",
+    "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 1 60",
+    "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 2 30",
+    "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 0 10",
+    "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 4 30"};
+
+// Search features compared against the search with all features enabled
+static const struct {
+    const char *name;
+    bool *enabled;
+} bench_features[] = {
+    {"aspiration", &features.aspiration},
+    {"reductions", &features.reductions},
+    {"reverse futility", &features.reverse_futility},
+    {"razoring", &features.razoring},
+    {"futility", &features.futility},
+    {"late move pruning", &features.late_move_pruning},
+    {"history", &features.history},
+    {"see pruning", &features.see_pruning},
+    {"internal reduction", &features.internal_reduction},
+    {"singular extension", &features.singular_extension},
+    {"upcoming repetition", &features.upcoming_repetition},
+};
 
 /*
     Benchmark for depth 6 with transposition table removed
@@ -18,6 +48,9 @@
 static inline void speedy_perft(Board *board, int depth, U64 *nodes);
 static inline void pseudo_perft(Board *board, int depth, U64 *nodes);
 static inline void make_unmake(Board *board, int depth, U64 *nodes);
+static U64 bench_search(int depth);
+
+static Info bench_info;
 
 // Compute time to complete task
 void benchmark(Board *board, int depth) {
@@ -34,6 +67,31 @@ void benchmark(Board *board, int depth) {
     printf("Time: %lf seconds, MNPS: %.3f\n", time, nodes / (time * 1000000));
 }
 
+// Compare nodes searched to a fixed depth with and without each feature
+void search_benchmark(int depth) {
+    int count = sizeof(bench_features) / sizeof(bench_features[0]);
+    U64 begin_time = get_time();
+    U64 nodes = bench_search(depth);
+    U64 time = get_time() - begin_time + 1;
+    Info info = bench_info;
+
+    printf("Depth %d, Nodes: %lld\n", depth, nodes);
+    printf("Time: %lld ms, NPS: %.0f\n", time, nodes * 1000.0 / time);
+    printf("Quiescence nodes: %lld\n", info.quiescence_nodes);
+    printf("Reductions: %lld, Re-searches: %lld\n\n", info.reductions,
+           info.researches);
+
+    for (int i = 0; i < count; i++) {
+        *bench_features[i].enabled = false;
+        U64 disabled_nodes = bench_search(depth);
+        *bench_features[i].enabled = true;
+
+        printf("%-20s Nodes without: %-12lld Saved: %.1f%%\n",
+               bench_features[i].name, disabled_nodes,
+               100.0 - nodes * 100.0 / disabled_nodes);
+    }
+}
+
 // Performance test for enumerating all moves to a certain depth
 void perft(Board *board, int depth, U64 *nodes) {
     Move moves[MAX_MOVES];
@@ -97,3 +155,30 @@ static inline void make_unmake(Board *board, int depth, U64 *nodes) {
         unmake_move(board, move);
     }
 }
+
+// Search all benchmark positions from an empty table and count nodes
+static U64 bench_search(int depth) {
+    Board board;
+    U64 nodes = 0;
+
+    bench_info = (Info){0};
+    for (int i = 0; i < BENCH_POSITIONS; i++) {
+        Parameter parameters = {0};
+        parameters.start_time = get_time();
+        parameters.max_depth = depth;
+        parameters.silent = true;
+
+        load_fen(&board, bench_positions[i]);
+        clear_transposition();
+        clear_search();
+        reset_search();
+        start_search(&board, parameters);
+        Info info = get_search_info();
+        nodes += info.nodes;
+        bench_info.reductions += info.reductions;
+        bench_info.researches += info.researches;
+        bench_info.quiescence_nodes += info.quiescence_nodes;
+    }
+
+    return nodes;
+}
@@ -115,6 +115,56 @@ void make_move(Board *board, Move move) {
     board->player = !board->player;
 }
 
+// Get hash of the position after a move without making it, so that hash
+// tables can be prefetched while the move is made
+U64 key_after(const Board *board, Move move) {
+    State state = board->state[board->ply];
+    U64 hash = board->hash ^ enpassant_key[state.enpassant] ^ side_key;
+
+    if (move == NULL_MOVE) {
+        return hash;
+    }
+
+    int start = get_move_start(move);
+    int end = get_move_end(move);
+    int flag = get_move_flag(move);
+    int piece = board->board[start];
+    int capture = board->board[end];
+    int castling = state.castling & castling_mask[start] & castling_mask[end];
+
+    hash ^= castling_key[state.castling] ^ castling_key[castling];
+
+    if (flag == CASTLING) {
+        int side = start < end;
+        int king_square = start + (side ? 2 : -2);
+        int rook_square = start + (side ? 1 : -1);
+        return hash ^ piece_key[piece][start] ^ piece_key[piece][king_square] ^
+               piece_key[piece - 2][end] ^ piece_key[piece - 2][rook_square];
+    }
+
+    hash ^= piece_key[piece][start] ^ piece_key[piece][end];
+
+    if (flag == ENPASSANT) {
+        int enemy = 8 * (start / 8) + (end & 7);
+        return hash ^ piece_key[board->board[enemy]][enemy];
+    }
+
+    if (capture != NO_PIECE) {
+        hash ^= piece_key[capture][end];
+    }
+
+    if (flag == PROMOTION) {
+        int promotion = make_piece(get_move_promotion(move) + KNIGHT,
+                                   get_piece_color(piece));
+        hash ^= piece_key[piece][end] ^ piece_key[promotion][end];
+    } else if (get_piece_type(piece) == PAWN && (start ^ end) == 16) {
+        hash ^= enpassant_key[start + (get_piece_color(piece) == WHITE ? 8
+                                                                       : -8)];
+    }
+
+    return hash;
+}
+
 // Undo a move on the board
 void unmake_move(Board *board, Move move) {
     State state = board->state[board->ply];
@@ -164,8 +214,9 @@ void make_null_move(Board *board) {
     // Save current board hash for repetition detection
     board->hashes[board->ply] = board->hash;
 
-    // Clear enpassant square
+    // Clear enpassant square and stop repetition detection at null move
     state.enpassant = NO_SQUARE;
+    state.draw_ply = 0;
 
     // Update position hashing for enpassant
     board->hash ^= enpassant_key[board->state[board->ply].enpassant] ^
@@ -2,82 +2,104 @@
 #include "attacks.h"
 #include "move.h"
 
+// Types of moves to generate
+enum GenerationType {
+    QUIESCENCE,
+    CAPTURES,
+    QUIETS,
+};
+
 static inline void generate_piece_moves(const Board *board, Move *moves,
-                                        int *count, int piece, bool capture);
+                                        int *count, int piece,
+                                        Bitboard targets);
 static inline void generate_pawn_moves(const Board *board, Move *moves,
-                                       int *count);
-static inline void generate_pawn_captures(const Board *board, Move *moves,
-                                          int *count);
+                                       int *count, int type);
+static inline void generate_castling_moves(const Board *board, Move *moves,
+                                           int *count);
 
 // Generate pseudo legal moves
 int generate_moves(const Board *board, Move *moves) {
+    int count = generate_captures(board, moves);
+    return count + generate_quiets(board, moves + count);
+}
+
+// Generate captures, promotions and enpassant moves
+int generate_captures(const Board *board, Move *moves) {
+    Bitboard enemies = board->occupancies[!board->player];
     int count = 0;
 
-    // Generate moves for each piece type
-    generate_pawn_moves(board, moves, &count);
-    generate_piece_moves(board, moves, &count, KNIGHT, false);
-    generate_piece_moves(board, moves, &count, BISHOP, false);
-    generate_piece_moves(board, moves, &count, ROOK, false);
-    generate_piece_moves(board, moves, &count, QUEEN, false);
-    generate_piece_moves(board, moves, &count, KING, false);
+    generate_pawn_moves(board, moves, &count, CAPTURES);
+    generate_piece_moves(board, moves, &count, KNIGHT, enemies);
+    generate_piece_moves(board, moves, &count, BISHOP, enemies);
+    generate_piece_moves(board, moves, &count, ROOK, enemies);
+    generate_piece_moves(board, moves, &count, QUEEN, enemies);
+    generate_piece_moves(board, moves, &count, KING, enemies);
 
-    // Generate castling moves if they are legal
-    int castling = board->state[board->ply].castling;
-    if (castling) {
-        if (board->player == WHITE) {
-            if ((CASTLE_WK & castling) &&
-                !(board->occupancies[2] & UINT64_C(0x60))) {
-                if (!is_attacked(board, E1, !board->player) &&
-                    !is_attacked(board, F1, !board->player) &&
-                    !is_attacked(board, G1, !board->player)) {
-                    moves[count++] = UINT16_C(0xF1C4);
-                }
-            }
-            if ((CASTLE_WQ & castling) &&
-                !(board->occupancies[2] & UINT64_C(0xE))) {
-                if (!is_attacked(board, E1, !board->player) &&
-                    !is_attacked(board, D1, !board->player) &&
-                    !is_attacked(board, C1, !board->player)) {
-                    moves[count++] = UINT16_C(0xF004);
-                }
-            }
-        } else {
-            if ((CASTLE_BK & castling) &&
-                !(board->occupancies[2] & UINT64_C(0x6000000000000000))) {
-                if (!is_attacked(board, E8, !board->player) &&
-                    !is_attacked(board, F8, !board->player) &&
-                    !is_attacked(board, G8, !board->player)) {
-                    moves[count++] = UINT16_C(0xFFFC);
-                }
-            }
-            if ((CASTLE_BQ & castling) &&
-                !(board->occupancies[2] & UINT64_C(0xE00000000000000))) {
-                if (!is_attacked(board, E8, !board->player) &&
-                    !is_attacked(board, D8, !board->player) &&
-                    !is_attacked(board, C8, !board->player)) {
-                    moves[count++] = UINT16_C(0xFE3C);
-                }
-            }
-        }
-    }
+    return count;
+}
+
+// Generate non capture moves that are not promotions
+int generate_quiets(const Board *board, Move *moves) {
+    Bitboard empty = ~board->occupancies[2];
+    int count = 0;
+
+    generate_pawn_moves(board, moves, &count, QUIETS);
+    generate_piece_moves(board, moves, &count, KNIGHT, empty);
+    generate_piece_moves(board, moves, &count, BISHOP, empty);
+    generate_piece_moves(board, moves, &count, ROOK, empty);
+    generate_piece_moves(board, moves, &count, QUEEN, empty);
+    generate_piece_moves(board, moves, &count, KING, empty);
+    generate_castling_moves(board, moves, &count);
 
     return count;
 }
 
 // Generate capture moves and queen promotions
 int generate_quiescence_moves(const Board *board, Move *moves) {
+    Bitboard enemies = board->occupancies[!board->player];
     int count = 0;
 
-    generate_pawn_captures(board, moves, &count);
-    generate_piece_moves(board, moves, &count, KNIGHT, true);
-    generate_piece_moves(board, moves, &count, BISHOP, true);
-    generate_piece_moves(board, moves, &count, ROOK, true);
-    generate_piece_moves(board, moves, &count, QUEEN, true);
-    generate_piece_moves(board, moves, &count, KING, true);
+    generate_pawn_moves(board, moves, &count, QUIESCENCE);
+    generate_piece_moves(board, moves, &count, KNIGHT, enemies);
+    generate_piece_moves(board, moves, &count, BISHOP, enemies);
+    generate_piece_moves(board, moves, &count, ROOK, enemies);
+    generate_piece_moves(board, moves, &count, QUEEN, enemies);
+    generate_piece_moves(board, moves, &count, KING, enemies);
 
     return count;
 }
 
+// Check if a move from another position can be generated in this position
+bool move_pseudo_legal(const Board *board, Move move) {
+    Move moves[MAX_MOVES];
+    int start = get_move_start(move), end = get_move_end(move);
+    int piece = board->board[start];
+    int count = 0;
+
+    if (move == NULL_MOVE || piece == NO_PIECE ||
+        get_piece_color(piece) != board->player) {
+        return false;
+    }
+
+    // Castling and pawn moves have special rules, so generate them
+    if (get_move_flag(move) == CASTLING) {
+        generate_castling_moves(board, moves, &count);
+    } else if (get_piece_type(piece) == PAWN) {
+        generate_pawn_moves(board, moves, &count, CAPTURES);
+        generate_pawn_moves(board, moves, &count, QUIETS);
+    } else {
+        return move == encode_move(start, end, NORMAL_MOVE, 0) &&
+               get_bit(get_attacks(board, start, get_piece_type(piece)), end);
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (moves[i] == move) {
+            return true;
+        }
+    }
+    return false;
+}
+
 // Generate only legal moves
 int generate_legal_moves(Board *board, Move *moves) {
     Move pseudo_moves[MAX_MOVES];
@@ -94,28 +116,26 @@ int generate_legal_moves(Board *board, Move *moves) {
     return count;
 }
 
-// Generate all moves for a piece type
+// Generate all moves for a piece type to target squares
 static inline void generate_piece_moves(const Board *board, Move *moves,
-                                        int *count, int piece, bool capture) {
+                                        int *count, int piece,
+                                        Bitboard targets) {
     Bitboard pieces = board->pieces[make_piece(piece, board->player)];
 
     // Iterate over each square in the piece bitboard
     while (pieces) {
         int start = pop_lsb(&pieces);
 
-        // Get only captures or all moves
-        Bitboard attacks = capture ? get_attacks(board, start, piece) &
-                                         board->occupancies[!board->player]
-                                   : get_attacks(board, start, piece);
+        Bitboard attacks = get_attacks(board, start, piece) & targets;
         while (attacks) {
             moves[(*count)++] = encode_move(start, pop_lsb(&attacks), 0, 0);
         }
     }
 }
 
-// Generate all pawn moves
+// Generate pawn moves of a generation type
 static inline void generate_pawn_moves(const Board *board, Move *moves,
-                                       int *count) {
+                                       int *count, int type) {
     int piece = make_piece(PAWN, board->player);
     int up = UP, upleft = UPLEFT, upright = UPRIGHT;
     Bitboard rank3 = UINT64_C(0xFF0000), rank7 = UINT64_C(0xFF000000000000);
@@ -131,13 +151,28 @@ static inline void generate_pawn_moves(const Board *board, Move *moves,
 
     Bitboard pawns = board->pieces[piece] & ~rank7;
     Bitboard empty = ~board->occupancies[2];
-
     Bitboard seventh_pawns = board->pieces[piece] & rank7;
-    Bitboard single_push = shift_bit(pawns, up) & empty;
-    Bitboard double_push = shift_bit(single_push & rank3, up) & empty;
 
-    // Promotion moves
+    if (type == QUIETS) {
+        Bitboard single_push = shift_bit(pawns, up) & empty;
+        Bitboard double_push = shift_bit(single_push & rank3, up) & empty;
+
+        // Single and double push pawn moves
+        while (single_push) {
+            int end = pop_lsb(&single_push);
+            moves[(*count)++] = encode_move(end - up, end, 0, 0);
+        }
+        while (double_push) {
+            int end = pop_lsb(&double_push);
+            moves[(*count)++] = encode_move(end - up - up, end, 0, 0);
+        }
+
+        return;
+    }
+
+    // Promotion moves, only to a queen in quiescence search
     if (seventh_pawns) {
+        int last = type == QUIESCENCE ? QUEEN : KNIGHT;
         Bitboard enemies = board->occupancies[!board->player];
         Bitboard left = shift_bit(seventh_pawns, upleft) & enemies;
         Bitboard right = shift_bit(seventh_pawns, upright) & enemies;
@@ -145,21 +180,21 @@ static inline void generate_pawn_moves(const Board *board, Move *moves,
 
         while (left) {
             int end = pop_lsb(&left);
-            for (int i = QUEEN; i >= KNIGHT; i--) {
+            for (int i = QUEEN; i >= last; i--) {
                 moves[(*count)++] =
                     encode_move(end - upleft, end, PROMOTION, i);
             }
         }
         while (right) {
             int end = pop_lsb(&right);
-            for (int i = QUEEN; i >= KNIGHT; i--) {
+            for (int i = QUEEN; i >= last; i--) {
                 moves[(*count)++] =
                     encode_move(end - upright, end, PROMOTION, i);
             }
         }
         while (middle) {
             int end = pop_lsb(&middle);
-            for (int i = QUEEN; i >= KNIGHT; i--) {
+            for (int i = QUEEN; i >= last; i--) {
                 moves[(*count)++] = encode_move(end - up, end, PROMOTION, i);
             }
         }
@@ -175,19 +210,9 @@ static inline void generate_pawn_moves(const Board *board, Move *moves,
         }
     }
 
-    // Single and double push pawn moves
-    while (single_push) {
-        int end = pop_lsb(&single_push);
-        moves[(*count)++] = encode_move(end - up, end, 0, 0);
-    }
-    while (double_push) {
-        int end = pop_lsb(&double_push);
-        moves[(*count)++] = encode_move(end - up - up, end, 0, 0);
-    }
-
     // Enpassant moves
     int ep = board->state[board->ply].enpassant;
-    if (ep != NO_SQUARE) {
+    if (type == CAPTURES && ep != NO_SQUARE) {
         if ((ep & 7) != 7 && board->board[ep - upleft] == piece) {
             moves[(*count)++] = encode_move(ep - upleft, ep, ENPASSANT, 0);
         }
@@ -197,55 +222,47 @@ static inline void generate_pawn_moves(const Board *board, Move *moves,
     }
 }
 
-// Generate all pawn captures and queen promotions
-static inline void generate_pawn_captures(const Board *board, Move *moves,
-                                          int *count) {
-    int piece = make_piece(PAWN, board->player);
-    int up = UP, upleft = UPLEFT, upright = UPRIGHT;
-    Bitboard rank7 = UINT64_C(0xFF000000000000);
-
-    // Flip direction if player is black
-    if (board->player == BLACK) {
-        rank7 = UINT64_C(0xFF00);
-        up = DOWN;
-        upleft = DOWNLEFT;
-        upright = DOWNRIGHT;
+// Generate castling moves if they are legal
+static inline void generate_castling_moves(const Board *board, Move *moves,
+                                           int *count) {
+    int castling = board->state[board->ply].castling;
+    if (!castling) {
+        return;
     }
 
-    Bitboard pawns = board->pieces[piece] & ~rank7;
-    Bitboard empty = ~board->occupancies[2];
-    Bitboard seventh_pawns = board->pieces[piece] & rank7;
-
-    // Queen promotion moves
-    if (seventh_pawns) {
-        Bitboard enemies = board->occupancies[!board->player];
-        Bitboard left = shift_bit(seventh_pawns, upleft) & enemies;
-        Bitboard right = shift_bit(seventh_pawns, upright) & enemies;
-        Bitboard middle = shift_bit(seventh_pawns, up) & empty;
-
-        while (left) {
-            int end = pop_lsb(&left);
-            moves[(*count)++] =
-                encode_move(end - upleft, end, PROMOTION, QUEEN);
+    if (board->player == WHITE) {
+        if ((CASTLE_WK & castling) &&
+            !(board->occupancies[2] & UINT64_C(0x60))) {
+            if (!is_attacked(board, E1, !board->player) &&
+                !is_attacked(board, F1, !board->player) &&
+                !is_attacked(board, G1, !board->player)) {
+                moves[(*count)++] = UINT16_C(0xF1C4);
+            }
         }
-        while (right) {
-            int end = pop_lsb(&right);
-            moves[(*count)++] =
-                encode_move(end - upright, end, PROMOTION, QUEEN);
+        if ((CASTLE_WQ & castling) &&
+            !(board->occupancies[2] & UINT64_C(0xE))) {
+            if (!is_attacked(board, E1, !board->player) &&
+                !is_attacked(board, D1, !board->player) &&
+                !is_attacked(board, C1, !board->player)) {
+                moves[(*count)++] = UINT16_C(0xF004);
+            }
         }
-        while (middle) {
-            int end = pop_lsb(&middle);
-            moves[(*count)++] = encode_move(end - up, end, PROMOTION, QUEEN);
+    } else {
+        if ((CASTLE_BK & castling) &&
+            !(board->occupancies[2] & UINT64_C(0x6000000000000000))) {
+            if (!is_attacked(board, E8, !board->player) &&
+                !is_attacked(board, F8, !board->player) &&
+                !is_attacked(board, G8, !board->player)) {
+                moves[(*count)++] = UINT16_C(0xFFFC);
+            }
         }
-    }
-
-    // Pawn attacks
-    while (pawns) {
-        int start = pop_lsb(&pawns);
-
-        Bitboard attacks = get_attacks(board, start, PAWN);
-        while (attacks) {
-            moves[(*count)++] = encode_move(start, pop_lsb(&attacks), 0, 0);
+        if ((CASTLE_BQ & castling) &&
+            !(board->occupancies[2] & UINT64_C(0xE00000000000000))) {
+            if (!is_attacked(board, E8, !board->player) &&
+                !is_attacked(board, D8, !board->player) &&
+                !is_attacked(board, C8, !board->player)) {
+                moves[(*count)++] = UINT16_C(0xFE3C);
+            }
         }
     }
 }
@@ -1,48 +1,161 @@
 #include "move_order.h"
+#include "attacks.h"
+#include "move_generation.h"
 
+static inline void score_captures(Board *board, Move *moves,
+                                  MoveList *move_list, int length);
+static inline void score_quiets(Thread *thread, Stack *stack, Move *moves,
+                                MoveList *move_list, int length);
+static inline bool quiet_pseudo_legal(Board *board, Move move);
 static inline int mvv_lva(int attacker, int victim);
+static inline int get_history(Thread *thread, Stack *stack, Move move);
+static inline void add_bonus(int16_t *entry, int bonus);
 
-// Score moves and save in move list
-void score_moves(Board *board, Stack *stack, Move *moves, MoveList *move_list,
-                 Move tt_move, int length) {
-    for (int i = 0; i < length; i++) {
-        Move move = moves[i];
-        int score = QUIET_MOVE;
-        int flag = get_move_flag(move);
-        int capture = board->board[get_move_end(move)];
+// Initialize move picker with moves that are tried before generating moves
+void init_move_picker(MovePicker *picker, Thread *thread, Stack *stack,
+                      Move tt_move) {
+    picker->stage = TT_STAGE;
+    picker->tt_move = tt_move;
+    picker->killer_moves[0] = stack->killer_moves[0];
+    picker->killer_moves[1] = stack->killer_moves[1];
+    picker->counter_move = NULL_MOVE;
 
-        // Score move
-        if (move == tt_move) {
-            score = TT_MOVE;
-        } else if (capture != NO_PIECE) {
-            score = mvv_lva(board->board[get_move_start(move)], capture);
-        } else if (move == stack->killer_moves[0]) {
-            score = KILLER_MOVE + 1;
-        } else if (move == stack->killer_moves[1]) {
-            score = KILLER_MOVE;
-        } else if (flag == NORMAL_MOVE) {
-            score = QUIET_MOVE;
-        } else if (flag == PROMOTION) {
-            score = PxR + get_move_promotion(move);
-        } else if (flag == ENPASSANT) {
-            score = PxP;
-        } else if (flag == CASTLING) {
-            score = QUIET_MOVE + 1;
+    // Root moves are searched in the order of the root move list
+    if (stack->ply == 0) {
+        picker->stage = ROOT_STAGE;
+        picker->index = thread->pv_index;
+        return;
+    }
+
+    // Counter move is indexed by piece and end square of the previous move
+    if (stack->ply >= 1 && (stack - 1)->move != NULL_MOVE) {
+        picker->counter_move =
+            thread->counter_moves[(stack - 1)->piece]
+                                 [get_move_end((stack - 1)->move)];
+    }
+}
+
+// Get next pseudo legal move or null move if there are no moves left
+Move next_move(MovePicker *picker, Thread *thread, Stack *stack) {
+    Board *board = &thread->board;
+    Move moves[MAX_MOVES], move;
+
+    switch (picker->stage) {
+    case TT_STAGE:
+        picker->stage++;
+        if (move_pseudo_legal(board, picker->tt_move)) {
+            return picker->tt_move;
         }
 
-        move_list[i].move = move;
-        move_list[i].score = score;
+        // Move of a stored entry is always legal in its own position
+        if (picker->tt_move != NULL_MOVE) {
+            thread->info.tt.collisions++;
+        }
+        // fall through
+
+    case CAPTURES_INIT_STAGE:
+        picker->count = generate_captures(board, moves);
+        score_captures(board, moves, picker->moves, picker->count);
+        picker->index = picker->bad_count = 0;
+        picker->stage++;
+        // fall through
+
+    case GOOD_CAPTURES_STAGE:
+        while (picker->index < picker->count) {
+            move = sort_moves(picker->moves, picker->count, picker->index);
+
+            // Save captures that lose material at the front to search them
+            // after killers, only captures of cheaper pieces can lose material
+            if (picker->moves[picker->index].score < EQUAL_CAPTURE &&
+                !see_ge(board, move, 0)) {
+                picker->moves[picker->bad_count++] =
+                    picker->moves[picker->index++];
+                continue;
+            }
+
+            picker->index++;
+            if (move != picker->tt_move) {
+                return move;
+            }
+        }
+        picker->index = 0;
+        picker->stage++;
+        // fall through
+
+    case KILLER1_STAGE:
+        picker->stage++;
+        move = picker->killer_moves[0];
+        if (move != picker->tt_move && quiet_pseudo_legal(board, move)) {
+            return move;
+        }
+        // fall through
+
+    case KILLER2_STAGE:
+        picker->stage++;
+        move = picker->killer_moves[1];
+        if (move != picker->tt_move && quiet_pseudo_legal(board, move)) {
+            return move;
+        }
+        // fall through
+
+    case COUNTER_STAGE:
+        picker->stage++;
+        move = picker->counter_move;
+        if (move != picker->tt_move && move != picker->killer_moves[0] &&
+            move != picker->killer_moves[1] &&
+            quiet_pseudo_legal(board, move)) {
+            return move;
+        }
+        // fall through
+
+    case BAD_CAPTURES_STAGE:
+        while (picker->index < picker->bad_count) {
+            move = picker->moves[picker->index++].move;
+            if (move != picker->tt_move) {
+                return move;
+            }
+        }
+        picker->stage++;
+        // fall through
+
+    case QUIETS_INIT_STAGE:
+        picker->count = generate_quiets(board, moves);
+        score_quiets(thread, stack, moves, picker->moves, picker->count);
+        picker->index = 0;
+        picker->stage++;
+        // fall through
+
+    case QUIETS_STAGE:
+        while (picker->index < picker->count) {
+            move = picker->moves[picker->index++].move;
+            if (move != picker->tt_move && move != picker->killer_moves[0] &&
+                move != picker->killer_moves[1] &&
+                move != picker->counter_move) {
+                return move;
+            }
+        }
+        picker->stage++;
+        break;
+
+    case ROOT_STAGE:
+        if (picker->index < thread->root_count) {
+            return thread->root_moves[picker->index++].move;
+        }
+        break;
     }
+
+    return NULL_MOVE;
 }
 
-// Score quiescence moves and save in move list
+// Score quiescence moves with transposition table move first
 void score_quiescence_moves(Board *board, Move *moves, MoveList *move_list,
-                            int length) {
+                            int length, Move tt_move) {
+    score_captures(board, moves, move_list, length);
+
     for (int i = 0; i < length; i++) {
-        Move move = moves[i];
-        move_list[i].move = moves[i];
-        move_list[i].score = mvv_lva(board->board[get_move_start(move)],
-                                     board->board[get_move_end(move)]);
+        if (moves[i] == tt_move) {
+            move_list[i].score = TT_MOVE;
+        }
     }
 }
 
@@ -63,6 +176,122 @@ Move sort_moves(MoveList *move_list, int length, int index) {
     return best_move.move;
 }
 
+// Reward quiet move that caused a beta cutoff and punish quiet moves before it
+void update_history(Thread *thread, Stack *stack, Move best_move,
+                    Move *quiet_moves, int quiet_count, int depth) {
+    Board *board = &thread->board;
+    int bonus = MIN(16 * depth * depth, 1200);
+
+    // Save counter move of the previous move
+    if (stack->ply >= 1 && (stack - 1)->move != NULL_MOVE) {
+        thread->counter_moves[(stack - 1)->piece]
+                             [get_move_end((stack - 1)->move)] = best_move;
+    }
+
+    for (int i = 0; i < quiet_count; i++) {
+        Move move = quiet_moves[i];
+        int start = get_move_start(move), end = get_move_end(move);
+        int piece = board->board[start];
+        int delta = move == best_move ? bonus : -bonus;
+
+        add_bonus(&thread->history[board->player][start][end], delta);
+        if (stack->ply >= 1 && (stack - 1)->continuation) {
+            add_bonus(&(stack - 1)->continuation[piece][end], delta);
+        }
+        if (stack->ply >= 2 && (stack - 2)->continuation) {
+            add_bonus(&(stack - 2)->continuation[piece][end], delta);
+        }
+    }
+}
+
+// Halve history between searches so that old moves lose their influence
+void age_history(Thread *thread) {
+    int16_t *history = &thread->history[0][0][0];
+    int16_t *continuation = &thread->continuation[0][0][0][0];
+
+    for (size_t i = 0; i < sizeof(thread->history) / sizeof(int16_t); i++) {
+        history[i] /= 2;
+    }
+    for (size_t i = 0; i < sizeof(thread->continuation) / sizeof(int16_t);
+         i++) {
+        continuation[i] /= 2;
+    }
+}
+
+// Clear history for a new game
+void clear_history(Thread *thread) {
+    memset(thread->history, 0, sizeof(thread->history));
+    memset(thread->counter_moves, 0, sizeof(thread->counter_moves));
+    memset(thread->continuation, 0, sizeof(thread->continuation));
+}
+
+// Score captures, promotions and enpassant moves and save in move list
+static inline void score_captures(Board *board, Move *moves,
+                                  MoveList *move_list, int length) {
+    for (int i = 0; i < length; i++) {
+        Move move = moves[i];
+        int flag = get_move_flag(move);
+        int capture = board->board[get_move_end(move)];
+        int score;
+
+        if (capture != NO_PIECE) {
+            score = mvv_lva(board->board[get_move_start(move)], capture);
+        } else if (flag == PROMOTION) {
+            score = PxR + get_move_promotion(move);
+        } else {
+            score = PxP;
+        }
+
+        move_list[i].move = move;
+        move_list[i].score = score;
+    }
+}
+
+// Score quiet moves by history and sort them with insertion sort
+static inline void score_quiets(Thread *thread, Stack *stack, Move *moves,
+                                MoveList *move_list, int length) {
+    for (int i = 0; i < length; i++) {
+        MoveList entry = {moves[i], QUIET_MOVE + get_history(thread, stack,
+                                                             moves[i])};
+        int j = i;
+
+        while (j > 0 && move_list[j - 1].score < entry.score) {
+            move_list[j] = move_list[j - 1];
+            j--;
+        }
+        move_list[j] = entry;
+    }
+}
+
+// Check if killer or counter move is a quiet move in this position
+static inline bool quiet_pseudo_legal(Board *board, Move move) {
+    return board->board[get_move_end(move)] == NO_PIECE &&
+           get_move_flag(move) == NORMAL_MOVE &&
+           move_pseudo_legal(board, move);
+}
+
+// Sum of history scores of a quiet move
+static inline int get_history(Thread *thread, Stack *stack, Move move) {
+    Board *board = &thread->board;
+    int start = get_move_start(move), end = get_move_end(move);
+    int piece = board->board[start];
+    int score = thread->history[board->player][start][end];
+
+    if (stack->ply >= 1 && (stack - 1)->continuation) {
+        score += (stack - 1)->continuation[piece][end];
+    }
+    if (stack->ply >= 2 && (stack - 2)->continuation) {
+        score += (stack - 2)->continuation[piece][end];
+    }
+
+    return score;
+}
+
+// History gravity keeps entries between -MAX_HISTORY and MAX_HISTORY
+static inline void add_bonus(int16_t *entry, int bonus) {
+    *entry += bonus - *entry * abs(bonus) / MAX_HISTORY;
+}
+
 // Most Valuable Victim - Least Valuable Attacker heuristic to sort moves
 static inline int mvv_lva(int attacker, int victim) {
     static const int mvv_lva[][13] = {
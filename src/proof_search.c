@@ -0,0 +1,519 @@
+#include "proof_search.h"
+#include "attacks.h"
+#include "move.h"
+#include "move_generation.h"
+#include "time_manager.h"
+
+#define PROOF_INFINITY (UINT32_C(1) << 30)
+#define PROOF_TABLE_SIZE (UINT64_C(1) << 20)
+#define PROOF_MARGIN 4
+#define CHECK_NODES 1024
+#define PROOF_NODES 262144
+#define PROOF_TIME_SHARE 0.1
+
+// Proof and disproof numbers of a position searched with a remaining depth
+typedef struct proof_entry {
+    U64 hash;
+    uint32_t proof;
+    uint32_t disproof;
+    uint8_t depth;
+} ProofEntry;
+
+// Search every position with proof numbers instead of alpha-beta
+bool use_proof_search;
+
+static ProofEntry *proof_table = NULL;
+static Parameter search_parameters;
+static int root_depth;
+static U64 nodes;
+static U64 check_nodes;
+static U64 node_limit;
+static volatile bool stop;
+
+static void prove(Board *board, int depth, uint32_t proof_threshold,
+                  uint32_t disproof_threshold, uint32_t *proof,
+                  uint32_t *disproof);
+static int filter_moves(Board *board, int depth, Move *moves, int count);
+static inline bool allowed_move(Move move);
+static void get_numbers(Board *board, int depth, uint32_t *proof,
+                        uint32_t *disproof);
+static inline void init_numbers(Board *board, int depth, int count,
+                                uint32_t *proof, uint32_t *disproof);
+static inline bool probe_numbers(U64 hash, int depth, uint32_t *proof,
+                                 uint32_t *disproof);
+static inline void set_numbers(U64 hash, int depth, uint32_t proof,
+                               uint32_t disproof);
+static inline int get_proof_depth(U64 hash, int depth);
+static int get_proof_pv(Board *board, int depth, Move *pv_moves);
+static Move get_best_move(Board *board, int depth);
+static void print_info(int depth, Move *pv_moves, int length);
+static inline void check_limits();
+static inline bool stopped();
+
+// Search for a forced mate with depth-first proof-number search (df-pn).
+// Return false without printing a best move if no mate within the limit
+// exists, so that a normal search can be started instead.
+bool start_proof_search(Board *original, Parameter parameters) {
+    static Board board;
+    Move pv_moves[MAX_PLY], shorter_pv_moves[MAX_PLY];
+    int pv_length = 0, max_mate = MAX_PLY / 2;
+    uint32_t proof, disproof;
+
+    // Allocate node table on first use
+    if (proof_table == NULL) {
+        proof_table = calloc(PROOF_TABLE_SIZE, sizeof(ProofEntry));
+        if (proof_table == NULL) {
+            fprintf(stderr, "Error: proof table failed to allocate\n");
+            exit(1);
+        }
+    }
+
+    board = *original;
+    search_parameters = parameters;
+    init_time_manager(&parameters, board.player);
+    nodes = 0;
+    check_nodes = 0;
+    node_limit = UINT64_MAX;
+
+    if (parameters.mate) {
+        max_mate = MIN(parameters.mate, max_mate);
+    }
+
+    // Prove a mate within the limit at once, since disproving every shorter
+    // mate first costs far more than the proof itself
+    root_depth = 2 * max_mate - 1;
+    prove(&board, root_depth, PROOF_INFINITY, PROOF_INFINITY, &proof,
+          &disproof);
+
+    if (proof == 0) {
+        pv_length = get_proof_pv(&board, root_depth, pv_moves);
+        print_info(pv_length, pv_moves, pv_length);
+    }
+
+    // Without go mate only a quick mate is played, otherwise the normal
+    // search chooses the move
+    if (pv_length == 0 && (!parameters.mate || (disproof == 0 && !stop))) {
+        return false;
+    }
+
+    // Look for shorter mates, each with as many nodes as searched so far
+    while (pv_length > 1 && !stop) {
+        root_depth = pv_length - 2;
+        node_limit = 2 * nodes;
+        prove(&board, root_depth, PROOF_INFINITY, PROOF_INFINITY, &proof,
+              &disproof);
+        node_limit = UINT64_MAX;
+
+        if (proof != 0) {
+            break;
+        }
+
+        int length = get_proof_pv(&board, root_depth, shorter_pv_moves);
+        if (length >= pv_length) {
+            break;
+        }
+
+        pv_length = length;
+        memcpy(pv_moves, shorter_pv_moves, sizeof(Move) * pv_length);
+        print_info(pv_length, pv_moves, pv_length);
+    }
+
+    // Best move can not be sent while pondering until ponderhit or stop
+    while (is_pondering() && !stop) {
+        nanosleep(&(struct timespec){.tv_nsec = 1000000}, NULL);
+    }
+
+    if (!parameters.silent) {
+        printf("bestmove");
+        if (pv_length > 0) {
+            print_move(pv_moves[0]);
+            if (pv_length > 1) {
+                printf(" ponder");
+                print_move(pv_moves[1]);
+            }
+        } else {
+            Move best_move = get_best_move(&board, root_depth);
+            if (best_move == NULL_MOVE) {
+                printf(" 0000");
+            } else {
+                print_move(best_move);
+            }
+        }
+        printf("\n");
+    }
+
+    return true;
+}
+
+// Clear the stop signal before a search is started, which is not done by
+// the search itself so that a stop right after go is kept
+void reset_proof_search() { stop = false; }
+
+// Signal proof search to stop
+void stop_proof_search() { stop = true; }
+
+// Free dynamically allocated memory
+void free_proof_search() {
+    if (proof_table) {
+        free(proof_table);
+        proof_table = NULL;
+    }
+}
+
+// Expand the most proving child until the proof or disproof number of the
+// position reaches its threshold. The attacker moves at odd depths and has
+// to checkmate before the depth runs out.
+static void prove(Board *board, int depth, uint32_t proof_threshold,
+                  uint32_t disproof_threshold, uint32_t *proof,
+                  uint32_t *disproof) {
+    Move moves[MAX_MOVES];
+    uint32_t proofs[MAX_MOVES], disproofs[MAX_MOVES];
+    U64 hashes[MAX_MOVES];
+    bool attacker = depth & 1;
+    U64 hash = board->hash;
+
+    // Root numbers depend on searchmoves and are not stored
+    bool store = depth != root_depth || !search_parameters.move_count;
+
+    if (++nodes >= check_nodes) {
+        check_limits();
+    }
+
+    int count = generate_legal_moves(board, moves);
+    count = filter_moves(board, depth, moves, count);
+
+    if (count == 0 || depth == 0) {
+        init_numbers(board, depth, count, proof, disproof);
+        if (store) {
+            set_numbers(hash, *proof ? depth : 0, *proof, *disproof);
+        }
+        return;
+    }
+
+    // Initialize numbers of all children once, later they are only updated
+    // from the node table since their positions may have transposed
+    for (int i = 0; i < count; i++) {
+        make_move(board, moves[i]);
+        hashes[i] = board->hash;
+        get_numbers(board, depth - 1, &proofs[i], &disproofs[i]);
+        unmake_move(board, moves[i]);
+    }
+
+    while (true) {
+        U64 sum = 0;
+        uint32_t minimum = PROOF_INFINITY, second = PROOF_INFINITY;
+        int best = 0;
+
+        // Attacker needs one proven move and defender needs all of them
+        for (int i = 0; i < count; i++) {
+            probe_numbers(hashes[i], depth - 1, &proofs[i], &disproofs[i]);
+
+            uint32_t value = attacker ? proofs[i] : disproofs[i];
+            sum += attacker ? disproofs[i] : proofs[i];
+            if (value < minimum) {
+                second = minimum;
+                minimum = value;
+                best = i;
+            } else if (value < second) {
+                second = value;
+            }
+        }
+
+        if (attacker) {
+            *proof = minimum;
+            *disproof = MIN(sum, PROOF_INFINITY);
+        } else {
+            *proof = MIN(sum, PROOF_INFINITY);
+            *disproof = minimum;
+        }
+
+        if (*proof >= proof_threshold || *disproof >= disproof_threshold ||
+            *proof == 0 || *disproof == 0 || stopped()) {
+            break;
+        }
+
+        // Search best child until the second best child becomes better by
+        // a margin, so that the search does not switch between them often
+        uint32_t child_proof, child_disproof;
+        uint32_t margin = second + second / PROOF_MARGIN + 1;
+        if (attacker) {
+            child_proof = MIN(proof_threshold, margin);
+            child_disproof = disproof_threshold - *disproof + disproofs[best];
+        } else {
+            child_proof = proof_threshold - *proof + proofs[best];
+            child_disproof = MIN(disproof_threshold, margin);
+        }
+
+        make_move(board, moves[best]);
+        prove(board, depth - 1, child_proof, child_disproof, &proofs[best],
+              &disproofs[best]);
+        unmake_move(board, moves[best]);
+    }
+
+    // Save the length of a proof instead of the depth, since the proof also
+    // holds for any depth down to its length
+    int proof_depth = depth;
+    if (*proof == 0) {
+        proof_depth = attacker ? depth : 0;
+        for (int i = 0; i < count; i++) {
+            int length = get_proof_depth(hashes[i], depth - 1) + 1;
+            if (attacker && proofs[i] == 0) {
+                proof_depth = MIN(proof_depth, length);
+            } else if (!attacker) {
+                proof_depth = MAX(proof_depth, length);
+            }
+        }
+    }
+
+    // Numbers of an unfinished search are not stored
+    if (store && !stopped()) {
+        set_numbers(hash, proof_depth, *proof, *disproof);
+    }
+}
+
+// Remove root moves excluded by searchmoves and quiet moves in the last
+// move of the attacker, since only a check can checkmate
+static int filter_moves(Board *board, int depth, Move *moves, int count) {
+    int filtered = 0;
+
+    for (int i = 0; i < count; i++) {
+        bool allowed = depth != root_depth || allowed_move(moves[i]);
+
+        if (allowed && depth == 1) {
+            make_move(board, moves[i]);
+            allowed = in_check(board, board->player);
+            unmake_move(board, moves[i]);
+        }
+
+        if (allowed) {
+            moves[filtered++] = moves[i];
+        }
+    }
+
+    return filtered;
+}
+
+// Check if root move is allowed by searchmoves
+static inline bool allowed_move(Move move) {
+    if (!search_parameters.move_count) {
+        return true;
+    }
+
+    for (int i = 0; i < search_parameters.move_count; i++) {
+        if (move == search_parameters.search_moves[i]) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Get proof and disproof numbers of a position from the node table or
+// initialize them for a new position
+static void get_numbers(Board *board, int depth, uint32_t *proof,
+                        uint32_t *disproof) {
+    Move moves[MAX_MOVES];
+
+    if (probe_numbers(board->hash, depth, proof, disproof)) {
+        return;
+    }
+
+    int count = generate_legal_moves(board, moves);
+    count = filter_moves(board, depth, moves, count);
+
+    init_numbers(board, depth, count, proof, disproof);
+    set_numbers(board->hash, *proof ? depth : 0, *proof, *disproof);
+}
+
+// Checkmate proves the position and anything else that ends it disproves.
+// Otherwise positions with fewer moves are easier to prove for the defender
+// and easier to disprove for the attacker, which makes checks search first.
+static inline void init_numbers(Board *board, int depth, int count,
+                                uint32_t *proof, uint32_t *disproof) {
+    bool attacker = depth & 1;
+
+    if (count == 0 || depth == 0) {
+        bool checkmate =
+            !attacker && count == 0 && in_check(board, board->player);
+        *proof = checkmate ? 0 : PROOF_INFINITY;
+        *disproof = checkmate ? PROOF_INFINITY : 0;
+    } else if (attacker) {
+        *proof = 1;
+        *disproof = count;
+    } else {
+        *proof = count;
+        *disproof = 1;
+    }
+}
+
+// Get proof and disproof numbers from the node table. A proof holds for
+// more remaining depth and a disproof holds for less remaining depth.
+static inline bool probe_numbers(U64 hash, int depth, uint32_t *proof,
+                                 uint32_t *disproof) {
+    ProofEntry *entry = &proof_table[hash & (PROOF_TABLE_SIZE - 1)];
+
+    if (entry->hash != hash) {
+        return false;
+    }
+
+    if (entry->proof == 0 && entry->depth <= depth) {
+        *proof = 0;
+        *disproof = PROOF_INFINITY;
+    } else if (entry->disproof == 0 && entry->depth >= depth) {
+        *proof = PROOF_INFINITY;
+        *disproof = 0;
+    } else if (entry->depth == depth) {
+        *proof = entry->proof;
+        *disproof = entry->disproof;
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+// Save proof and disproof numbers to the node table
+static inline void set_numbers(U64 hash, int depth, uint32_t proof,
+                               uint32_t disproof) {
+    ProofEntry *entry = &proof_table[hash & (PROOF_TABLE_SIZE - 1)];
+
+    entry->hash = hash;
+    entry->proof = proof;
+    entry->disproof = disproof;
+    entry->depth = depth;
+}
+
+// Get length of a proven position from the node table
+static inline int get_proof_depth(U64 hash, int depth) {
+    ProofEntry *entry = &proof_table[hash & (PROOF_TABLE_SIZE - 1)];
+
+    if (entry->hash == hash && entry->proof == 0 && entry->depth <= depth) {
+        return entry->depth;
+    }
+
+    return depth;
+}
+
+// Follow the shortest proven moves of the attacker and the longest proven
+// moves of the defender from the node table. Positions whose entries were
+// replaced are proven again.
+static int get_proof_pv(Board *board, int depth, Move *pv_moves) {
+    Move moves[MAX_MOVES];
+    int length = 0;
+
+    for (; depth > 0 && !stop; depth--) {
+        bool attacker = depth & 1;
+        int count = generate_legal_moves(board, moves);
+        count = filter_moves(board, depth, moves, count);
+
+        Move proven_move = NULL_MOVE;
+        for (int retry = 0; retry < 2 && proven_move == NULL_MOVE; retry++) {
+            uint32_t proof, disproof;
+            int best_depth = 0;
+
+            if (retry) {
+                prove(board, depth, PROOF_INFINITY, PROOF_INFINITY, &proof,
+                      &disproof);
+            }
+
+            for (int i = 0; i < count; i++) {
+                make_move(board, moves[i]);
+                bool proven = probe_numbers(board->hash, depth - 1, &proof,
+                                            &disproof) &&
+                              proof == 0;
+                int proof_depth = get_proof_depth(board->hash, depth - 1);
+                unmake_move(board, moves[i]);
+
+                if (proven &&
+                    (proven_move == NULL_MOVE ||
+                     (attacker ? proof_depth < best_depth
+                               : proof_depth > best_depth))) {
+                    proven_move = moves[i];
+                    best_depth = proof_depth;
+                }
+            }
+        }
+
+        if (proven_move == NULL_MOVE) {
+            break;
+        }
+
+        make_move(board, proven_move);
+        pv_moves[length++] = proven_move;
+    }
+
+    for (int i = length - 1; i >= 0; i--) {
+        unmake_move(board, pv_moves[i]);
+    }
+
+    return length;
+}
+
+// Get root move with the smallest proof number when no mate was proven
+static Move get_best_move(Board *board, int depth) {
+    Move moves[MAX_MOVES], best_move = NULL_MOVE;
+    uint32_t best_proof = PROOF_INFINITY;
+
+    int count = generate_legal_moves(board, moves);
+
+    for (int i = 0; i < count; i++) {
+        uint32_t proof, disproof;
+
+        if (!allowed_move(moves[i])) {
+            continue;
+        }
+
+        make_move(board, moves[i]);
+        if (!probe_numbers(board->hash, depth - 1, &proof, &disproof)) {
+            proof = 1;
+        }
+        unmake_move(board, moves[i]);
+
+        if (best_move == NULL_MOVE || proof < best_proof) {
+            best_proof = proof;
+            best_move = moves[i];
+        }
+    }
+
+    return best_move;
+}
+
+// Print search information of the proven mate to the GUI
+static void print_info(int depth, Move *pv_moves, int length) {
+    if (search_parameters.silent) {
+        return;
+    }
+
+    U64 elapsed_time = get_time() - search_parameters.start_time + 1;
+
+    printf("info ");
+    printf("depth %d ", depth);
+    printf("seldepth %d ", depth);
+    printf("time %lld ", elapsed_time);
+    printf("nodes %lld ", nodes);
+    printf("score mate %d ", (length + 1) / 2);
+    printf("nps %.0lf ", (nodes * 1000.0) / elapsed_time);
+    printf("pv");
+    for (int i = 0; i < length; i++) {
+        print_move(pv_moves[i]);
+    }
+    printf("\n");
+}
+
+// Check if search is stopped or ran out of nodes for a shorter mate
+static inline bool stopped() { return stop || nodes >= node_limit; }
+
+// Stop when the time or node limit is reached. Searches without go mate
+// only spend a share of their time and nodes on proofs before the normal
+// search.
+static inline void check_limits() {
+    if (time_over() || (search_parameters.max_nodes &&
+                        nodes >= search_parameters.max_nodes)) {
+        stop = true;
+    }
+    if (!search_parameters.mate &&
+        (nodes >= PROOF_NODES || optimum_time_over(PROOF_TIME_SHARE))) {
+        stop = true;
+    }
+    check_nodes = nodes + CHECK_NODES;
+}
@@ -4,34 +4,60 @@
 #include "move.h"
 #include "move_generation.h"
 #include "move_order.h"
+#include "search.h"
+#include "transposition.h"
 
 // Continue limited search until a quiet position is reached
-int quiescence_search(Board *board, int alpha, int beta) {
+int quiescence_search(Thread *thread, int alpha, int beta, int ply) {
+    Board *board = &thread->board;
     Move moves[MAX_MOVES];
     MoveList move_list[MAX_MOVES];
+    int old_alpha = alpha;
 
-    if (time_over) {
+    if (thread->stop) {
         return INVALID_SCORE;
     }
 
-    info.nodes++;
+    thread->info.nodes++;
+    thread->info.quiescence_nodes++;
+
+    // Check if position is in transposition table, any depth is sufficient
+    Move tt_move = NULL_MOVE, best_move = NULL_MOVE;
+    int static_eval;
+    int score = get_transposition(board->hash, alpha, beta, ply, 0, &tt_move,
+                                  &static_eval, &thread->info.tt);
+    if (score != INVALID_SCORE) {
+        thread->info.tt.cutoffs++;
+        return score;
+    }
 
     // Lower bound of score
-    int score = eval(board);
-    if (score > alpha) {
-        if (score >= beta) {
+    if (static_eval == INVALID_SCORE) {
+        static_eval = eval(board);
+    }
+    if (static_eval > alpha) {
+        if (static_eval >= beta) {
+            set_transposition(board->hash, beta, static_eval, LOWER_BOUND,
+                              ply, 0, NULL_MOVE, &thread->info.tt);
             return beta;
         }
-        alpha = score;
+        alpha = static_eval;
     }
 
     // Search only captures and queen promotions
     int count = generate_quiescence_moves(board, moves);
-    score_quiescence_moves(board, moves, move_list, count);
+    score_quiescence_moves(board, moves, move_list, count, tt_move);
 
     for (int i = 0; i < count; i++) {
         Move move = sort_moves(move_list, count, i);
 
+        // Skip captures that lose material
+        if (features.see_pruning && move_list[i].score < EQUAL_CAPTURE &&
+            !see_ge(board, move, 0)) {
+            continue;
+        }
+
+        prefetch_transposition(key_after(board, move));
         make_move(board, move);
 
         // Remove illegal moves
@@ -41,18 +67,32 @@ int quiescence_search(Board *board, int alpha, int beta) {
         }
 
         // Recursively search game tree
-        score = -quiescence_search(board, -beta, -alpha);
+        score = -quiescence_search(thread, -beta, -alpha, ply + 1);
         unmake_move(board, move);
 
+        if (thread->stop) {
+            return INVALID_SCORE;
+        }
+
         // Alpha cutoff
         if (score > alpha) {
+            best_move = move;
+
             // Beta cutoff
             if (score >= beta) {
+                set_transposition(board->hash, beta, static_eval,
+                                  LOWER_BOUND, ply, 0, best_move,
+                                  &thread->info.tt);
                 return beta;
             }
             alpha = score;
         }
     }
 
+    // Save position to transposition table with depth 0
+    set_transposition(board->hash, alpha, static_eval,
+                      alpha > old_alpha ? EXACT_BOUND : UPPER_BOUND, ply, 0,
+                      best_move, &thread->info.tt);
+
     return alpha;
 }
@@ -5,93 +5,364 @@
 #include "move_generation.h"
 #include "move_order.h"
 #include "quiescence.h"
+#include "tablebase.h"
+#include "time_manager.h"
 #include "transposition.h"
 
-Info info;
-int game_ply;
-bool time_over;
+#define ASPIRATION_DEPTH 5
+#define ASPIRATION_WINDOW 50
+#define REDUCTION_DEPTH 3
+#define REVERSE_FUTILITY_DEPTH 6
+#define REVERSE_FUTILITY_MARGIN 80
+#define RAZOR_DEPTH 2
+#define RAZOR_MARGIN 300
+#define FUTILITY_DEPTH 6
+#define FUTILITY_MARGIN 100
+#define LATE_MOVE_DEPTH 4
+#define LATE_MOVE_COUNT 3
+#define INTERNAL_REDUCTION_DEPTH 4
+#define SINGULAR_DEPTH 8
+#define SINGULAR_MARGIN 2
+#define CHECK_NODES 1024
+#define CURRMOVE_TIME 3000
 
-static int search(Board *board, Stack *stack, int alpha, int beta, int depth);
+int game_ply;
+int multi_pv = 1;
+bool debug_mode;
+Features features = {
+    .aspiration = true,
+    .reductions = true,
+    .reverse_futility = true,
+    .razoring = true,
+    .futility = true,
+    .late_move_pruning = true,
+    .history = true,
+    .see_pruning = true,
+    .internal_reduction = true,
+    .singular_extension = true,
+    .upcoming_repetition = true,
+};
+
+static Thread *threads = NULL;
+static int thread_count = 0;
+static Parameter search_parameters;
+static int reductions[MAX_PLY][MAX_MOVES];
+
+static void *iterative_deepening(void *argument);
+static int aspiration_search(Thread *thread, int depth);
+static int search(Thread *thread, Stack *stack, int alpha, int beta,
+                  int depth);
 static inline bool is_repetition(Board *board);
+static inline bool upcoming_repetition(Board *board, int ply);
 static inline void update_pv(Stack *stack, Move move);
-static inline bool check_time(Parameter *parameters, U64 elapsed_time,
-                              int player);
+static inline void init_root_moves(Thread *thread);
+static inline void start_iteration(Thread *thread);
+static inline void update_root_move(Thread *thread, Stack *stack, Move move,
+                                    int score, bool best, U64 nodes);
+static inline void sort_root_moves(RootMove *root_moves, int count);
+static void print_info(Thread *thread, int depth, int line, int bound);
+static inline void clear_stack(Stack *stack);
+static inline U64 get_nodes();
+static inline void check_limits(Thread *thread);
+static inline bool mate_found(Parameter *parameters, int score);
+
+// Initialize late move reduction table
+void init_search() {
+    for (int depth = 1; depth < MAX_PLY; depth++) {
+        for (int count = 1; count < MAX_MOVES; count++) {
+            reductions[depth][count] =
+                (int)(0.75 + log(depth) * log(count) / 2.25);
+        }
+    }
+}
+
+// Allocate search threads
+void init_threads(int count) {
+    count = MAX(count, 1);
+
+    // Free memory if it is already allocated
+    free_threads();
 
+    // Each thread needs its own board and stack, so allocate them on the heap
+    threads = calloc(count, sizeof(Thread));
+    if (threads == NULL) {
+        fprintf(stderr, "Error: search threads failed to allocate\n");
+        exit(1);
+    }
+
+    thread_count = count;
+    for (int i = 0; i < thread_count; i++) {
+        threads[i].id = i;
+    }
+}
+
+// Free dynamically allocated memory
+void free_threads() {
+    if (threads) {
+        free(threads);
+        threads = NULL;
+    }
+    thread_count = 0;
+}
+
+// Search position with all threads sharing the transposition table
 void start_search(Board *board, Parameter parameters) {
+    Thread *main_thread = &threads[0];
     Move best_move = NULL_MOVE, ponder_move = NULL_MOVE;
 
-    // Clear search info
-    info = (Info){0};
-
-    // Initialize stack
-    Stack stack[MAX_PLY + 1] = {0};
-    for (int ply = 0; ply <= MAX_PLY; ply++) {
-        stack[ply].ply = ply;
+    search_parameters = parameters;
+    init_time_manager(&parameters, board->player);
+    age_transposition();
+
+    // Copy position and clear search info for each thread
+    for (int i = 0; i < thread_count; i++) {
+        threads[i].board = *board;
+        threads[i].info = (Info){0};
+        threads[i].pv_index = 0;
+        threads[i].check_nodes = 0;
+        age_history(&threads[i]);
+        init_root_moves(&threads[i]);
     }
 
-    // Iterative deepening
+    RootMove *root_moves = main_thread->root_moves;
+    int root_count = main_thread->root_count;
+    int lines = MIN(multi_pv, root_count), stability = 0;
     int max_depth = parameters.max_depth ? parameters.max_depth : MAX_DEPTH;
-    for (int depth = 1; depth <= max_depth; depth++) {
-        // Clear stack
-        memset(&stack, 0, sizeof(stack));
-        for (int ply = 0; ply <= MAX_PLY; ply++) {
-            stack[ply].ply = ply;
+
+    // Tablebases score every root move exactly, so no search is needed
+    bool tablebase_root =
+        tablebase_pieces &&
+        probe_root(&main_thread->board, root_moves, root_count);
+    if (tablebase_root) {
+        best_move = root_moves[0].move;
+        ponder_move = root_moves[0].pv_length > 1 ? root_moves[0].pv_moves[1]
+                                                  : NULL_MOVE;
+        main_thread->info.tbhits = root_count;
+        main_thread->info.depth = main_thread->info.seldepth =
+            root_moves[0].pv_length;
+
+        for (int line = 0; line < lines; line++) {
+            print_info(main_thread, root_moves[line].pv_length, line,
+                       EXACT_BOUND);
         }
+    }
 
-        int score = search(board, stack, -INFINITY, INFINITY, depth);
+    // Helper threads search until the main thread stops them (Lazy SMP)
+    for (int i = 1; i < thread_count && !tablebase_root; i++) {
+        pthread_create(&threads[i].tid, NULL, iterative_deepening,
+                       &threads[i]);
+    }
+
+    // Iterative deepening
+    for (int depth = 1; depth <= max_depth && root_count && !tablebase_root;
+         depth++) {
+        start_iteration(main_thread);
+
+        // Search the best lines one after another (MultiPV), each line
+        // excludes the root moves of the lines before it
+        for (int line = 0; line < lines && !main_thread->stop; line++) {
+            main_thread->pv_index = line;
+            aspiration_search(main_thread, depth);
+        }
 
         // Stop searching if time is over and discard unfinished score
-        if (time_over) {
-            time_over = false;
+        if (main_thread->stop) {
             break;
         }
 
         // Save principal variation moves to the transposition table
-        set_pv_moves(board, stack, score);
-
-        best_move = stack[0].pv_moves[0];
-        ponder_move = stack[0].pv_moves[1];
-        U64 elapsed_time = get_time() - parameters.start_time + 1;
-
-        // Print info
-        printf("info ");
-        printf("depth %d ", depth);
-        printf("seldepth %d ", info.seldepth);
-        printf("time %lld ", elapsed_time);
-        printf("nodes %lld ", info.nodes);
-        printf("score cp %d ", score);
-        printf("hashfull %d ", get_hashfull());
-        printf("nps %.0lf ", (info.nodes * 1000.0) / elapsed_time);
-        printf("pv");
-        for (int i = 0; i < stack[0].pv_length; i++) {
-            print_move(stack[0].pv_moves[i]);
+        set_pv_moves(&main_thread->board, root_moves[0].pv_moves,
+                     root_moves[0].pv_length, root_moves[0].score);
+
+        // Count iterations in a row with the same best move
+        stability = root_moves[0].move == best_move ? stability + 1 : 0;
+
+        best_move = root_moves[0].move;
+        ponder_move = root_moves[0].pv_length > 1 ? root_moves[0].pv_moves[1]
+                                                  : NULL_MOVE;
+        main_thread->info.depth = depth;
+
+        for (int line = 0; line < lines; line++) {
+            print_info(main_thread, depth, line, EXACT_BOUND);
         }
-        printf("\n");
 
         // Check if we still have time to search deeper
-        if (check_time(&parameters, elapsed_time, board->player)) {
+        if (stop_iterating(stability) ||
+            mate_found(&parameters, root_moves[0].score)) {
             break;
         }
     }
 
-    printf("bestmove");
-    print_move(best_move);
-    if (ponder_move) {
-        printf(" ponder");
-        print_move(ponder_move);
+    // A stop before the first iteration finished still sends a legal move
+    if (best_move == NULL_MOVE && root_count) {
+        best_move = root_moves[0].move;
+    }
+
+    // Best move can not be sent while pondering until ponderhit or stop
+    while (is_pondering() && !main_thread->stop) {
+        nanosleep(&(struct timespec){.tv_nsec = 1000000}, NULL);
+    }
+
+    // Stop and wait for helper threads
+    stop_search();
+    for (int i = 1; i < thread_count && !tablebase_root; i++) {
+        pthread_join(threads[i].tid, NULL);
+    }
+
+    if (debug_mode && !parameters.silent) {
+        Info info = get_search_info();
+        printf("info string nodes %lld qnodes %lld reductions %lld "
+               "researches %lld\n",
+               info.nodes, info.quiescence_nodes, info.reductions,
+               info.researches);
+        print_tt_stats();
+    }
+
+    if (!parameters.silent) {
+        printf("bestmove");
+        if (best_move == NULL_MOVE) {
+            printf(" 0000");
+        } else {
+            print_move(best_move);
+        }
+        if (ponder_move) {
+            printf(" ponder");
+            print_move(ponder_move);
+        }
+        printf("\n");
+    }
+}
+
+// Clear history of all threads for a new game
+void clear_search() {
+    for (int i = 0; i < thread_count; i++) {
+        clear_history(&threads[i]);
+    }
+}
+
+// Clear the stop signal of all threads before a search is started, which
+// is not done by the search itself so that a stop right after go is kept
+void reset_search() {
+    for (int i = 0; i < thread_count; i++) {
+        threads[i].stop = false;
+    }
+}
+
+// Signal all threads to stop searching
+void stop_search() {
+    for (int i = 0; i < thread_count; i++) {
+        threads[i].stop = true;
+    }
+}
+
+// Get search stats of all threads from the last search
+Info get_search_info() {
+    Info total = threads[0].info;
+
+    for (int i = 1; i < thread_count; i++) {
+        total.nodes += threads[i].info.nodes;
+        total.reductions += threads[i].info.reductions;
+        total.researches += threads[i].info.researches;
+        total.quiescence_nodes += threads[i].info.quiescence_nodes;
+        total.tbhits += threads[i].info.tbhits;
+        total.tt.probes += threads[i].info.tt.probes;
+        total.tt.hits += threads[i].info.tt.hits;
+        total.tt.depth_hits += threads[i].info.tt.depth_hits;
+        total.tt.cutoffs += threads[i].info.tt.cutoffs;
+        total.tt.replacements += threads[i].info.tt.replacements;
+        total.tt.collisions += threads[i].info.tt.collisions;
+    }
+
+    return total;
+}
+
+// Print transposition table stats of all threads from the last search with
+// the hit rate in permill
+void print_tt_stats() {
+    TTStats tt = get_search_info().tt;
+
+    printf("info string tt probes %lld hits %lld depth hits %lld cutoffs %lld "
+           "replacements %lld collisions %lld hitrate %lld hashfull %d\n",
+           tt.probes, tt.hits, tt.depth_hits, tt.cutoffs, tt.replacements,
+           tt.collisions, tt.probes ? tt.hits * 1000 / tt.probes : 0,
+           get_hashfull());
+}
+
+// Iterative deepening loop for helper threads
+static void *iterative_deepening(void *argument) {
+    Thread *thread = argument;
+
+    // Odd threads start one ply deeper so that threads search different depths
+    for (int depth = 1 + (thread->id & 1);
+         depth <= MAX_DEPTH && thread->root_count; depth++) {
+        start_iteration(thread);
+        aspiration_search(thread, depth);
+
+        if (thread->stop) {
+            break;
+        }
+        thread->info.depth = depth;
+    }
+
+    return NULL;
+}
+
+// Search with a narrow window around the previous score and widen on failure
+static int aspiration_search(Thread *thread, int depth) {
+    RootMove *root_moves = thread->root_moves + thread->pv_index;
+    int count = thread->root_count - thread->pv_index;
+    int alpha = -INFINITY, beta = INFINITY, delta = ASPIRATION_WINDOW;
+    int score = root_moves[0].previous_score;
+
+    // Scores at shallow depths are too unstable for a narrow window
+    if (features.aspiration && depth >= ASPIRATION_DEPTH) {
+        alpha = MAX(score - delta, -INFINITY);
+        beta = MIN(score + delta, INFINITY);
+    }
+
+    clear_stack(thread->stack);
+
+    while (true) {
+        score = search(thread, thread->stack, alpha, beta, depth);
+
+        if (thread->stop) {
+            return score;
+        }
+
+        // Move best root move to the front, the order of moves that are
+        // not better than alpha stays the same
+        sort_root_moves(root_moves, count);
+
+        if (score <= alpha && alpha > -INFINITY) {
+            // Fail low, so move beta down and widen alpha
+            print_info(thread, depth, thread->pv_index, UPPER_BOUND);
+            beta = (alpha + beta) / 2;
+            alpha = MAX(score - delta, -INFINITY);
+        } else if (score >= beta && beta < INFINITY) {
+            // Fail high, so widen beta
+            print_info(thread, depth, thread->pv_index, LOWER_BOUND);
+            beta = MIN(score + delta, INFINITY);
+        } else {
+            // Sort line among the lines searched before
+            sort_root_moves(thread->root_moves, thread->pv_index + 1);
+            return score;
+        }
+
+        delta += delta / 2;
     }
-    printf("\n");
 }
 
 // Search board for best move
-static int search(Board *board, Stack *stack, int alpha, int beta, int depth) {
+static int search(Thread *thread, Stack *stack, int alpha, int beta,
+                  int depth) {
+    Board *board = &thread->board;
     int tt_flag = UPPER_BOUND;
     int ply = stack->ply;
     bool pv_node = beta - alpha > 1;
     bool root_node = ply == 0;
 
     if (!root_node) {
-        if (time_over) {
+        if (thread->stop) {
             return INVALID_SCORE;
         }
 
@@ -101,6 +372,16 @@ static int search(Board *board, Stack *stack, int alpha, int beta, int depth) {
             return DRAW_SCORE;
         }
 
+        // Draw is reachable if a reversible move repeats earlier position
+        if (features.upcoming_repetition && alpha < DRAW_SCORE &&
+            upcoming_repetition(board, ply)) {
+            alpha = DRAW_SCORE;
+            if (alpha >= beta) {
+                stack->pv_length = 0;
+                return alpha;
+            }
+        }
+
         // Mate distance pruning
         alpha = MAX(alpha, -INFINITY + ply);
         beta = MIN(beta, INFINITY - ply - 1);
@@ -119,23 +400,88 @@ static int search(Board *board, Stack *stack, int alpha, int beta, int depth) {
     // Quiescence search at leaf nodes
     if (depth == 0 || ply == MAX_PLY) {
         stack->pv_length = 0;
-        return quiescence_search(board, alpha, beta);
+        return quiescence_search(thread, alpha, beta, ply);
+    }
+
+    thread->info.nodes++;
+    thread->info.seldepth = MAX(thread->info.seldepth, ply);
+
+    // Check search limits every thousand nodes instead of every node
+    if (thread->info.nodes >= thread->check_nodes) {
+        check_limits(thread);
+    }
+
+    // Check if position is in transposition table
+    Move tt_move = NULL_MOVE;
+    int tt_eval;
+    int score = get_transposition(board->hash, alpha, beta, ply, depth,
+                                  &tt_move, &tt_eval, &thread->info.tt);
+
+    // Return score in non-pv nodes or if score is exact, but not when a move
+    // is excluded since the score of the entry includes that move
+    if (!root_node && !stack->excluded_move && score != INVALID_SCORE &&
+        (!pv_node || (score > alpha && score < beta))) {
+        thread->info.tt.cutoffs++;
+        stack->pv_length = 0;
+        return score;
+    }
+
+    // Tablebases know the result of positions with few pieces, wins are
+    // scored below mates since the distance to mate is not probed
+    int wdl;
+    if (!root_node && !stack->excluded_move && tablebase_pieces &&
+        get_population(board->occupancies[2]) <= tablebase_pieces &&
+        probe_wdl(board, &wdl)) {
+        thread->info.tbhits++;
+        stack->pv_length = 0;
+        return wdl == WDL_WIN    ? TABLEBASE_SCORE - ply
+               : wdl == WDL_LOSS ? -TABLEBASE_SCORE + ply
+                                 : DRAW_SCORE;
     }
 
-    info.nodes++;
-    info.seldepth = MAX(info.seldepth, ply);
+    // Static evaluation for pruning near the horizon, which is saved in the
+    // transposition table to skip evaluation when the position is repeated
+    int static_eval = check                      ? -INFINITY
+                      : tt_eval != INVALID_SCORE ? tt_eval
+                                                 : eval(board);
+    bool prune = !pv_node && !check && !is_mate_score(alpha) &&
+                 !is_mate_score(beta);
+
+    // Reverse futility pruning
+    // Prune if static evaluation is far above beta even after a margin
+    if (features.reverse_futility && prune &&
+        depth <= REVERSE_FUTILITY_DEPTH &&
+        static_eval - REVERSE_FUTILITY_MARGIN * depth >= beta) {
+        stack->pv_length = 0;
+        return beta;
+    }
+
+    // Razoring
+    // Drop into quiescence search if static evaluation is far below alpha
+    if (features.razoring && prune && depth <= RAZOR_DEPTH &&
+        static_eval + RAZOR_MARGIN * depth < alpha) {
+        score = quiescence_search(thread, alpha, beta, ply);
+        if (depth == 1 || score <= alpha) {
+            stack->pv_length = 0;
+            return score;
+        }
+    }
 
     // Null move pruning
     // Do not use in the endgame to avoid zugzwang positions
     if (depth >= 3 && !check && !pv_node && !(stack - 1)->null_move &&
+        !stack->excluded_move &&
         (board->occupancies[board->player] ^
          board->pieces[make_piece(PAWN, board->player)] ^
          board->pieces[make_piece(KING, board->player)])) {
         int R = depth >= 6 ? 3 : 2;
 
         stack->null_move = true;
+        stack->move = NULL_MOVE;
+        stack->continuation = NULL;
+        prefetch_transposition(key_after(board, NULL_MOVE));
         make_null_move(board);
-        int score = -search(board, stack + 1, -beta, -beta + 1, depth - R - 1);
+        score = -search(thread, stack + 1, -beta, -beta + 1, depth - R - 1);
         unmake_null_move(board);
         stack->null_move = false;
 
@@ -145,29 +491,74 @@ static int search(Board *board, Stack *stack, int alpha, int beta, int depth) {
         }
     }
 
-    // Check if position is in transposition table
-    Move tt_move = NULL_MOVE;
-    int score =
-        get_transposition(board->hash, alpha, beta, ply, depth, &tt_move);
-
-    // Return score in non-pv nodes or if score is exact
-    if (!root_node && score != INVALID_SCORE &&
-        (!pv_node || (score > alpha && score < beta))) {
-        stack->pv_length = 0;
-        return score;
+    // Internal iterative reduction
+    // Without a transposition table move the node was not searched before
+    // and move ordering is poor, so search it with less depth
+    if (features.internal_reduction && !root_node &&
+        depth >= INTERNAL_REDUCTION_DEPTH && tt_move == NULL_MOVE) {
+        depth--;
     }
 
-    // Generate pseudo legal moves and score them
-    Move moves[MAX_MOVES], best_move = NULL_MOVE;
-    MoveList move_list[MAX_MOVES];
-    int count = generate_moves(board, moves), moves_count = 0;
-    score_moves(board, stack, moves, move_list, tt_move, count);
+    // Principal variation is empty until a move raises alpha
+    stack->pv_length = 0;
+
+    // Generate pseudo legal moves in stages as they are needed
+    Move quiet_moves[MAX_MOVES], best_move = NULL_MOVE, move;
+    int moves_count = 0, quiet_count = 0;
+    MovePicker picker;
+    init_move_picker(&picker, thread, stack, tt_move);
 
     // Iterate over moves
-    bool pv_found = false;
-    for (int i = 0; i < count; i++) {
-        // Move next best move to the front
-        Move move = sort_moves(move_list, count, i);
+    while ((move = next_move(&picker, thread, stack)) != NULL_MOVE) {
+        if (move == stack->excluded_move) {
+            continue;
+        }
+
+        int piece = board->board[get_move_start(move)];
+        int end = get_move_end(move);
+        bool quiet =
+            board->board[end] == NO_PIECE && get_move_flag(move) == NORMAL_MOVE;
+        U64 nodes = thread->info.nodes;
+        int extension = 0;
+
+        // Singular extension
+        // Extend transposition table move if every other move fails low
+        // against a score below the lower bound of the move
+        if (features.singular_extension && !root_node && move == tt_move &&
+            depth >= SINGULAR_DEPTH && !stack->excluded_move) {
+            Transposition entry;
+            if (probe_transposition(board->hash, ply, &entry) &&
+                entry.depth >= depth - 3 && entry.flag != UPPER_BOUND &&
+                !is_mate_score(entry.score)) {
+                int singular_beta = entry.score - SINGULAR_MARGIN * depth;
+
+                stack->excluded_move = move;
+                score = search(thread, stack, singular_beta - 1, singular_beta,
+                               (depth - 1) / 2);
+                stack->excluded_move = NULL_MOVE;
+                stack->pv_length = 0;
+
+                if (thread->stop) {
+                    return INVALID_SCORE;
+                }
+
+                if (score < singular_beta) {
+                    extension = 1;
+                } else if (singular_beta >= beta) {
+                    // Multi-cut pruning
+                    // Other moves also fail high, so this node fails high
+                    return singular_beta;
+                }
+            }
+        }
+        int new_depth = depth - 1 + extension;
+
+        // Fetch the entry of the next position while the move is made,
+        // unless the move can still be pruned below
+        bool prunable = prune && quiet && moves_count > 0;
+        if (!prunable) {
+            prefetch_transposition(key_after(board, move));
+        }
 
         make_move(board, move);
 
@@ -179,26 +570,102 @@ static int search(Board *board, Stack *stack, int alpha, int beta, int depth) {
 
         moves_count++;
 
+        // Report root move in long searches
+        if (root_node && thread->id == 0 && !search_parameters.silent &&
+            get_time() - search_parameters.start_time >= CURRMOVE_TIME) {
+            printf("info depth %d currmove", depth);
+            print_move(move);
+            printf(" currmovenumber %d\n", thread->pv_index + moves_count);
+        }
+
+        // Prune quiet moves in hopeless nodes near the horizon
+        bool gives_check = in_check(board, board->player);
+        if (prune && quiet && !gives_check && moves_count > 1) {
+            // Futility pruning
+            // Skip moves if static evaluation and a margin is below alpha
+            if (features.futility && depth <= FUTILITY_DEPTH &&
+                static_eval + FUTILITY_MARGIN * depth <= alpha) {
+                unmake_move(board, move);
+                continue;
+            }
+
+            // Late move pruning
+            // Skip moves that are ordered late in shallow nodes
+            if (features.late_move_pruning && depth <= LATE_MOVE_DEPTH &&
+                moves_count > LATE_MOVE_COUNT + depth * depth) {
+                unmake_move(board, move);
+                continue;
+            }
+        }
+
+        // Quiet moves that were not pruned fetch their entry only now
+        if (prunable) {
+            prefetch_transposition(board->hash);
+        }
+
+        // Save move for history heuristics of the next plies
+        stack->move = move;
+        stack->piece = piece;
+        stack->continuation = thread->continuation[piece][end];
+        if (quiet) {
+            quiet_moves[quiet_count++] = move;
+        }
+
         // Principal variation search
-        if (!pv_found) {
-            // Search pv move with full window
-            score = -search(board, stack + 1, -beta, -alpha, depth - 1);
+        if (moves_count == 1) {
+            // Search first move with full window
+            score = -search(thread, stack + 1, -beta, -alpha, new_depth);
         } else {
+            int reduction = 0;
+
+            // Late move reductions for quiet moves that are ordered late
+            if (features.reductions && depth >= REDUCTION_DEPTH && quiet &&
+                !check && !gives_check) {
+                reduction = reductions[MIN(depth, MAX_PLY - 1)]
+                                      [MIN(moves_count, MAX_MOVES - 1)];
+
+                // Reduce less in pv nodes and for killer moves
+                reduction -= pv_node;
+                reduction -= move == stack->killer_moves[0] ||
+                             move == stack->killer_moves[1];
+                reduction = MIN(MAX(reduction, 0), new_depth - 1);
+
+                if (reduction) {
+                    thread->info.reductions++;
+                }
+            }
+
             // Search other moves with null window [alpha, alpha + 1]
-            score = -search(board, stack + 1, -alpha - 1, -alpha, depth - 1);
+            // Otherwise every move of a fail low node is searched with the
+            // full window, which explodes inside narrow aspiration windows
+            score = -search(thread, stack + 1, -alpha - 1, -alpha,
+                            new_depth - reduction);
+
+            // If reduced move fails high, search again with full depth
+            if (reduction && score > alpha) {
+                thread->info.researches++;
+                score =
+                    -search(thread, stack + 1, -alpha - 1, -alpha, new_depth);
+            }
 
-            // If fail high, search again with full window
-            if (score > alpha) {
-                score = -search(board, stack + 1, -beta, -alpha, depth - 1);
+            // If fail high in a pv node, search again with full window
+            if (score > alpha && score < beta) {
+                score = -search(thread, stack + 1, -beta, -alpha, new_depth);
             }
         }
 
         unmake_move(board, move);
 
-        if (time_over) {
+        if (thread->stop) {
             return INVALID_SCORE;
         }
 
+        if (root_node) {
+            update_root_move(thread, stack, move, score,
+                             moves_count == 1 || score > alpha,
+                             thread->info.nodes - nodes);
+        }
+
         // Alpha cutoff
         if (score > alpha) {
             best_move = move;
@@ -209,11 +676,15 @@ static int search(Board *board, Stack *stack, int alpha, int beta, int depth) {
             // Beta cutoff
             if (score >= beta) {
                 // Store quiet moves that cause beta cutoffs
-                if (board->board[get_move_end(move)] == NO_PIECE &&
-                    get_move_flag(move) == NORMAL_MOVE &&
-                    stack->killer_moves[0] != move) {
-                    stack->killer_moves[1] = stack->killer_moves[0];
-                    stack->killer_moves[0] = move;
+                if (quiet) {
+                    if (stack->killer_moves[0] != move) {
+                        stack->killer_moves[1] = stack->killer_moves[0];
+                        stack->killer_moves[0] = move;
+                    }
+                    if (features.history) {
+                        update_history(thread, stack, move, quiet_moves,
+                                       quiet_count, depth);
+                    }
                 }
 
                 alpha = beta;
@@ -223,17 +694,25 @@ static int search(Board *board, Stack *stack, int alpha, int beta, int depth) {
 
             alpha = score;
             tt_flag = EXACT_BOUND;
-            pv_found = true;
         }
     }
 
-    // Checkmate and stalemate
+    // Checkmate and stalemate, or only the excluded move is legal
     if (moves_count == 0) {
+        if (stack->excluded_move) {
+            return alpha;
+        }
         alpha = check ? -INFINITY + ply : DRAW_SCORE;
     }
 
-    // Save position to transposition table
-    set_transposition(board->hash, alpha, tt_flag, ply, depth, best_move);
+    // Save position to transposition table, except for lines after the first
+    // at the root and searches with an excluded move because they do not
+    // search all moves
+    if ((!root_node || !thread->pv_index) && !stack->excluded_move) {
+        set_transposition(board->hash, alpha,
+                          check ? INVALID_SCORE : static_eval, tt_flag, ply,
+                          depth, best_move, &thread->info.tt);
+    }
 
     return alpha;
 }
@@ -250,6 +729,39 @@ static inline bool is_repetition(Board *board) {
     return false;
 }
 
+// Check if side to move has a reversible move to an earlier position
+static inline bool upcoming_repetition(Board *board, int ply) {
+    int draw_ply = board->state[board->ply].draw_ply;
+    Bitboard occupancy = board->occupancies[2];
+
+    for (int i = 3; i <= draw_ply; i += 2) {
+        Move move =
+            get_cuckoo_move(board->hash ^ board->hashes[board->ply - i]);
+        if (move == NULL_MOVE) {
+            continue;
+        }
+
+        int start = get_move_start(move);
+        int end = get_move_end(move);
+        if (get_between(start, end) & occupancy) {
+            continue;
+        }
+
+        // Inside the search tree either side repeating the position is a draw
+        if (ply > i) {
+            return true;
+        }
+
+        // Before the root only a move of the side to move repeats
+        int square = board->board[start] == NO_PIECE ? end : start;
+        if (get_piece_color(board->board[square]) == board->player) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
 // Update principal variation
 static inline void update_pv(Stack *stack, Move move) {
     *stack->pv_moves = move;
@@ -258,30 +770,182 @@ static inline void update_pv(Stack *stack, Move move) {
     stack->pv_length = (stack + 1)->pv_length + 1;
 }
 
-// Check if there is enough time to search deeper
-static inline bool check_time(Parameter *parameters, U64 elapsed_time,
-                              int player) {
-    // Do not stop if infinite time
-    if (parameters->infinite ||
-        (!parameters->white_time && !parameters->black_time)) {
-        return false;
+// Print search info of the main thread
+static void print_info(Thread *thread, int depth, int line, int bound) {
+    RootMove *root_move = &thread->root_moves[line];
+    int score = root_move->score;
+
+    if (thread->id != 0 || search_parameters.silent) {
+        return;
+    }
+
+    U64 elapsed_time = get_time() - search_parameters.start_time + 1;
+    U64 nodes = get_nodes();
+
+    printf("info ");
+    printf("depth %d ", depth);
+    printf("seldepth %d ", thread->info.seldepth);
+    printf("multipv %d ", line + 1);
+    printf("time %lld ", elapsed_time);
+    printf("nodes %lld ", nodes);
+    if (is_mate_score(score)) {
+        printf("score mate %d ", score > 0 ? score_to_mate(score)
+                                           : -score_to_mate(score));
+    } else {
+        printf("score cp %d ", score);
+    }
+    if (bound == LOWER_BOUND) {
+        printf("lowerbound ");
+    } else if (bound == UPPER_BOUND) {
+        printf("upperbound ");
+    }
+    printf("hashfull %d ", get_hashfull());
+    if (tablebase_pieces) {
+        printf("tbhits %lld ", get_search_info().tbhits);
+    }
+    printf("nps %.0lf ", (nodes * 1000.0) / elapsed_time);
+    printf("pv");
+    for (int i = 0; i < root_move->pv_length; i++) {
+        print_move(root_move->pv_moves[i]);
+    }
+    printf("\n");
+}
+
+// Generate legal moves at the root that are allowed by searchmoves
+static inline void init_root_moves(Thread *thread) {
+    Move moves[MAX_MOVES];
+    int count = generate_legal_moves(&thread->board, moves);
+
+    thread->root_count = 0;
+    for (int i = 0; i < count; i++) {
+        bool allowed = search_parameters.move_count == 0;
+        for (int j = 0; j < search_parameters.move_count; j++) {
+            if (moves[i] == search_parameters.search_moves[j]) {
+                allowed = true;
+            }
+        }
+
+        if (allowed) {
+            thread->root_moves[thread->root_count++] =
+                (RootMove){.move = moves[i],
+                           .score = -INFINITY,
+                           .previous_score = -INFINITY};
+        }
     }
+}
+
+// Order root moves by score and then by nodes used in the last iteration,
+// since moves with large subtrees are most likely to become the best move
+static inline void start_iteration(Thread *thread) {
+    RootMove *root_moves = thread->root_moves;
 
-    // Stop if time is up
-    if (parameters->move_time && elapsed_time >= parameters->move_time) {
-        return true;
+    for (int i = 1; i < thread->root_count; i++) {
+        RootMove root_move = root_moves[i];
+        int j = i;
+
+        while (j > 0 && (root_moves[j - 1].score < root_move.score ||
+                         (root_moves[j - 1].score == root_move.score &&
+                          root_moves[j - 1].nodes < root_move.nodes))) {
+            root_moves[j] = root_moves[j - 1];
+            j--;
+        }
+        root_moves[j] = root_move;
     }
 
-    // Calculate target time to search
-    double factor = game_ply < 20 ? 1 : MIN(3 - game_ply / 20.0, 1);
-    double time =
-        player == WHITE
-            ? parameters->white_increment + parameters->white_time / 40.0
-            : parameters->black_increment + parameters->black_time / 40.0;
-    double target = time * factor;
+    for (int i = 0; i < thread->root_count; i++) {
+        root_moves[i].previous_score = root_moves[i].score;
+        root_moves[i].nodes = 0;
+    }
+}
+
+// Save score and principal variation of a root move, moves that are not
+// better than alpha only have an upper bound and are sorted last
+static inline void update_root_move(Thread *thread, Stack *stack, Move move,
+                                    int score, bool best, U64 nodes) {
+    RootMove *root_move = thread->root_moves;
+    while (root_move->move != move) {
+        root_move++;
+    }
+
+    root_move->nodes += nodes;
+
+    if (!best) {
+        root_move->score = -INFINITY;
+        return;
+    }
 
-    // Calculate expected time to search based on previous search
-    double expected_time = 4 * elapsed_time;
+    root_move->score = score;
+    root_move->pv_moves[0] = move;
+    memcpy(root_move->pv_moves + 1, (stack + 1)->pv_moves,
+           (stack + 1)->pv_length * sizeof(Move));
+    root_move->pv_length = (stack + 1)->pv_length + 1;
+}
+
+// Stable insertion sort of root moves by score
+static inline void sort_root_moves(RootMove *root_moves, int count) {
+    for (int i = 1; i < count; i++) {
+        RootMove root_move = root_moves[i];
+        int j = i;
+
+        while (j > 0 && root_moves[j - 1].score < root_move.score) {
+            root_moves[j] = root_moves[j - 1];
+            j--;
+        }
+        root_moves[j] = root_move;
+    }
+}
+
+// Clear search stack before each iteration
+static inline void clear_stack(Stack *stack) {
+    memset(stack, 0, (MAX_PLY + 1) * sizeof(Stack));
+    for (int ply = 0; ply <= MAX_PLY; ply++) {
+        stack[ply].ply = ply;
+    }
+}
+
+// Get total number of nodes searched by all threads
+static inline U64 get_nodes() {
+    U64 nodes = 0;
+    for (int i = 0; i < thread_count; i++) {
+        nodes += threads[i].info.nodes;
+    }
+    return nodes;
+}
+
+// Stop all threads if the time or node limit is reached
+static inline void check_limits(Thread *thread) {
+    U64 max_nodes = search_parameters.max_nodes;
+
+    // Always finish the first iteration to have a best move
+    bool can_stop = threads[0].info.depth > 0;
+
+    thread->check_nodes = thread->info.nodes + CHECK_NODES;
+    if (can_stop && time_over()) {
+        stop_search();
+        return;
+    }
+
+    if (!max_nodes) {
+        return;
+    }
+
+    U64 nodes = get_nodes();
+    if (nodes >= max_nodes) {
+        if (can_stop) {
+            stop_search();
+        }
+        thread->check_nodes = thread->info.nodes + 1;
+        return;
+    }
+
+    // Check again when the remaining nodes could be used up by all threads
+    U64 remaining = (max_nodes - nodes) / thread_count;
+    thread->check_nodes =
+        thread->info.nodes + MAX(MIN(remaining, CHECK_NODES), 1);
+}
 
-    return expected_time >= target + 2000;
+// Check if a mate within the number of moves of go mate is found
+static inline bool mate_found(Parameter *parameters, int score) {
+    return parameters->mate && score > 0 && is_mate_score(score) &&
+           score_to_mate(score) <= parameters->mate;
 }
@@ -0,0 +1,1030 @@
+#include "tablebase.h"
+#include "attacks.h"
+#include "board.h"
+#include "move.h"
+#include "move_generation.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define MAX_TABLEBASES 64
+#define MAX_DISTANCE 254
+#define BROKEN 255
+#define EXIT_FLAG (UINT32_C(1) << 31)
+
+/*
+    Tables store every position of a material signature with white having
+    the stronger pieces, so black positions are probed with colors flipped.
+
+    Index: side to move, white king slot, then 6 bits for every other piece
+    in the order black king, white pieces, black pieces. Pawnless tables put
+    the white king in the a1-d1-d4 triangle (10 slots), tables with pawns
+    only mirror files so the white king is on files a to d (32 slots).
+
+    DTM file: one byte per position, 0 draw, 255 invalid position, otherwise
+    1 + plies to mate. Odd plies win for the side to move, even plies lose.
+    WDL file: two bits per position, 0 draw, 1 win, 2 loss, 3 invalid.
+*/
+
+// Table of one material signature
+typedef struct tablebase {
+    char name[16];
+    int pieces[TABLEBASE_PIECES];
+    int count;
+    int pawns;
+    int white_key;
+    int black_key;
+    U64 size;
+    uint8_t *wdl;
+    uint8_t *dtm;
+} Tablebase;
+
+// Positions with the same distance to mate waiting to be propagated
+typedef struct bucket {
+    uint32_t *indices;
+    size_t count;
+    size_t capacity;
+} Bucket;
+
+// Largest number of pieces of the loaded tables
+int tablebase_pieces;
+
+static Tablebase tablebases[MAX_TABLEBASES];
+static int tablebase_count = 0;
+static int king_slots[64];
+static int triangle[10] = {A1, B1, C1, D1, B2, C2, D2, C3, D3, D4};
+
+static void init_signatures();
+static inline int compare_sides(const int *a, int a_count, const int *b,
+                                int b_count);
+static inline void add_signature(const int *white, int white_count,
+                                 const int *black, int black_count);
+static void load_tablebase(Tablebase *tb, const char *path);
+static uint8_t *map_file(const char *path, U64 size);
+static void unmap_tablebase(Tablebase *tb);
+static bool find_position(const Board *board, Tablebase **table, U64 *index);
+static inline bool enpassant_possible(const Board *board);
+static inline int get_material_key(const Board *board, int color);
+static inline bool read_dtm(const Board *board, int *value);
+static inline int value_score(int value);
+static inline int child_score(int score);
+static int get_tablebase_pv(Board *board, Move *pv_moves, int max_length);
+static void canonicalize(const Tablebase *tb, int *squares);
+static inline void sort_squares(const Tablebase *tb, int *squares);
+static inline int flip_diagonal(int square);
+static inline U64 get_index(const Tablebase *tb, const int *squares,
+                            int player);
+static bool decode_index(const Tablebase *tb, U64 index, int *squares,
+                         int *player);
+static void set_position(Board *board, const Tablebase *tb,
+                         const int *squares, int player);
+static inline void toggle_piece(Board *board, int piece, int square);
+static void generate_tablebase(Tablebase *tb, const char *path);
+static void init_position(Tablebase *tb, Board *board, U64 index,
+                          uint8_t *values, uint8_t *counters,
+                          uint8_t *exit_wins, uint8_t *exit_losses,
+                          Bucket *buckets);
+static void propagate(Tablebase *tb, Board *board, U64 index, int distance,
+                      uint8_t *values, uint8_t *counters, uint8_t *exit_wins,
+                      uint8_t *exit_losses, Bucket *buckets);
+static inline int get_predecessors(const Tablebase *tb, Board *board,
+                                   const int *squares, int player,
+                                   U64 *predecessors, int *enpassants);
+static bool read_enpassant(Board *board, int *value);
+static inline void push_bucket(Bucket *bucket, uint32_t index);
+static void write_tablebase(const Tablebase *tb, const char *path,
+                            const uint8_t *values);
+
+// Map all tables of a directory into memory
+void init_tablebases(const char *path) {
+    init_signatures();
+    free_tablebases();
+
+    if (!path[0] || !strcmp(path, "<empty>")) {
+        return;
+    }
+
+    for (int i = 0; i < tablebase_count; i++) {
+        load_tablebase(&tablebases[i], path);
+        if (tablebases[i].dtm) {
+            tablebase_pieces = MAX(tablebase_pieces, tablebases[i].count);
+        }
+    }
+}
+
+// Unmap all tables
+void free_tablebases() {
+    for (int i = 0; i < tablebase_count; i++) {
+        unmap_tablebase(&tablebases[i]);
+    }
+    tablebase_pieces = 0;
+}
+
+// Probe win, draw, or loss for the side to move
+bool probe_wdl(const Board *board, int *wdl) {
+    Tablebase *tb;
+    U64 index;
+
+    // Bare kings are always a draw
+    if (get_population(board->occupancies[2]) == 2) {
+        *wdl = WDL_DRAW;
+        return true;
+    }
+
+    if (!find_position(board, &tb, &index)) {
+        return false;
+    }
+
+    int value = (tb->wdl[index >> 2] >> ((index & 3) * 2)) & 3;
+    if (value == 3) {
+        return false;
+    }
+
+    *wdl = value == 1 ? WDL_WIN : value == 2 ? WDL_LOSS : WDL_DRAW;
+    return true;
+}
+
+// Probe mate score for the side to move
+bool probe_dtm(const Board *board, int *score) {
+    int value;
+
+    if (!read_dtm(board, &value)) {
+        return false;
+    }
+
+    *score = value_score(value);
+    return true;
+}
+
+// Score all root moves with distance to mate and sort them, so that the
+// search can be skipped
+bool probe_root(Board *board, RootMove *root_moves, int count) {
+    int score;
+
+    if (!count || !probe_dtm(board, &score)) {
+        return false;
+    }
+
+    for (int i = 0; i < count; i++) {
+        RootMove *root_move = &root_moves[i];
+        bool found;
+
+        make_move(board, root_move->move);
+        found = probe_dtm(board, &score);
+        if (found) {
+            root_move->pv_length =
+                1 + get_tablebase_pv(board, root_move->pv_moves + 1,
+                                     MAX_PLY - 1);
+        }
+        unmake_move(board, root_move->move);
+
+        // Child position can not be probed if enpassant is possible
+        if (!found) {
+            return false;
+        }
+
+        root_move->score = child_score(score);
+        root_move->pv_moves[0] = root_move->move;
+    }
+
+    // Sort root moves by score
+    for (int i = 1; i < count; i++) {
+        RootMove root_move = root_moves[i];
+        int j = i;
+
+        while (j > 0 && root_moves[j - 1].score < root_move.score) {
+            root_moves[j] = root_moves[j - 1];
+            j--;
+        }
+        root_moves[j] = root_move;
+    }
+
+    return true;
+}
+
+// Generate all tables up to a number of pieces, tables with fewer pieces
+// first since captures and promotions lead into them
+void generate_tablebases(const char *path, int pieces) {
+    init_signatures();
+    free_tablebases();
+
+    for (int i = 0; i < tablebase_count; i++) {
+        if (tablebases[i].count <= pieces) {
+            U64 start_time = get_time();
+
+            generate_tablebase(&tablebases[i], path);
+            load_tablebase(&tablebases[i], path);
+            if (!tablebases[i].dtm) {
+                fprintf(stderr, "Error: %s failed to load\n",
+                        tablebases[i].name);
+                exit(1);
+            }
+            tablebase_pieces = MAX(tablebase_pieces, tablebases[i].count);
+
+            printf("%-8s %10lld positions %8.2f seconds\n",
+                   tablebases[i].name, tablebases[i].size,
+                   (get_time() - start_time) / 1000.0);
+        }
+    }
+}
+
+// List material signatures once with white having the stronger pieces,
+// sorted by number of pieces and then by number of pawns
+static void init_signatures() {
+    int sides[32][2], counts[32], side_count = 0;
+
+    if (tablebase_count) {
+        return;
+    }
+
+    // Extra pieces of one side from strongest to weakest
+    counts[side_count++] = 0;
+    for (int a = QUEEN; a >= PAWN; a--) {
+        sides[side_count][0] = a;
+        counts[side_count++] = 1;
+    }
+    for (int a = QUEEN; a >= PAWN; a--) {
+        for (int b = a; b >= PAWN; b--) {
+            sides[side_count][0] = a;
+            sides[side_count][1] = b;
+            counts[side_count++] = 2;
+        }
+    }
+
+    for (int i = 0; i < side_count; i++) {
+        for (int j = 0; j < side_count; j++) {
+            int extra = counts[i] + counts[j];
+            if (extra && extra <= TABLEBASE_PIECES - 2 &&
+                compare_sides(sides[i], counts[i], sides[j], counts[j]) >= 0) {
+                add_signature(sides[i], counts[i], sides[j], counts[j]);
+            }
+        }
+    }
+
+    for (int i = 1; i < tablebase_count; i++) {
+        Tablebase tb = tablebases[i];
+        int j = i;
+
+        while (j > 0 && (tablebases[j - 1].count > tb.count ||
+                         (tablebases[j - 1].count == tb.count &&
+                          tablebases[j - 1].pawns > tb.pawns))) {
+            tablebases[j] = tablebases[j - 1];
+            j--;
+        }
+        tablebases[j] = tb;
+    }
+
+    // Slots of the white king in the a1-d1-d4 triangle
+    for (int square = A1; square <= H8; square++) {
+        king_slots[square] = -1;
+    }
+    for (int slot = 0; slot < 10; slot++) {
+        king_slots[triangle[slot]] = slot;
+    }
+}
+
+// Compare strength of the extra pieces of two sides
+static inline int compare_sides(const int *a, int a_count, const int *b,
+                                int b_count) {
+    if (a_count != b_count) {
+        return a_count - b_count;
+    }
+    for (int i = 0; i < a_count; i++) {
+        if (a[i] != b[i]) {
+            return a[i] - b[i];
+        }
+    }
+    return 0;
+}
+
+// Add table of kings and extra pieces of each side
+static inline void add_signature(const int *white, int white_count,
+                                 const int *black, int black_count) {
+    const char codes[] = "PNBRQK";
+    Tablebase *tb = &tablebases[tablebase_count++];
+    int length = 0;
+
+    *tb = (Tablebase){0};
+    tb->pieces[tb->count++] = W_KING;
+    tb->pieces[tb->count++] = B_KING;
+
+    tb->name[length++] = 'K';
+    for (int i = 0; i < white_count; i++) {
+        tb->pieces[tb->count++] = make_piece(white[i], WHITE);
+        tb->name[length++] = codes[white[i]];
+        tb->white_key += 1 << (4 * white[i]);
+        tb->pawns += white[i] == PAWN;
+    }
+    tb->name[length++] = 'v';
+    tb->name[length++] = 'K';
+    for (int i = 0; i < black_count; i++) {
+        tb->pieces[tb->count++] = make_piece(black[i], BLACK);
+        tb->name[length++] = codes[black[i]];
+        tb->black_key += 1 << (4 * black[i]);
+        tb->pawns += black[i] == PAWN;
+    }
+    tb->name[length] = '\0';
+
+    tb->size = 2 * (tb->pawns ? 32 : 10);
+    for (int i = 1; i < tb->count; i++) {
+        tb->size *= 64;
+    }
+}
+
+// Map the files of a table if both exist with the expected size
+static void load_tablebase(Tablebase *tb, const char *path) {
+    char file[4096];
+
+    snprintf(file, sizeof(file), "%s/%s.wdl", path, tb->name);
+    tb->wdl = map_file(file, (tb->size + 3) / 4);
+
+    snprintf(file, sizeof(file), "%s/%s.dtm", path, tb->name);
+    tb->dtm = map_file(file, tb->size);
+
+    if (!tb->wdl || !tb->dtm) {
+        unmap_tablebase(tb);
+    }
+}
+
+// Map a file read only, or return NULL if it does not exist
+static uint8_t *map_file(const char *path, U64 size) {
+    struct stat status;
+    int file = open(path, O_RDONLY);
+
+    if (file < 0) {
+        return NULL;
+    }
+
+    if (fstat(file, &status) || (U64)status.st_size != size) {
+        fprintf(stderr, "Error: %s has the wrong size\n", path);
+        close(file);
+        return NULL;
+    }
+
+    void *data = mmap(NULL, size, PROT_READ, MAP_SHARED, file, 0);
+    close(file);
+
+    return data == MAP_FAILED ? NULL : data;
+}
+
+// Unmap the files of a table
+static void unmap_tablebase(Tablebase *tb) {
+    if (tb->wdl) {
+        munmap(tb->wdl, (tb->size + 3) / 4);
+        tb->wdl = NULL;
+    }
+    if (tb->dtm) {
+        munmap(tb->dtm, tb->size);
+        tb->dtm = NULL;
+    }
+}
+
+// Find the loaded table and index of a position. Castling and enpassant
+// are not part of the tables.
+static bool find_position(const Board *board, Tablebase **table, U64 *index) {
+    int squares[TABLEBASE_PIECES];
+
+    if (get_population(board->occupancies[2]) > TABLEBASE_PIECES ||
+        board->state[board->ply].castling || enpassant_possible(board)) {
+        return false;
+    }
+
+    int white_key = get_material_key(board, WHITE);
+    int black_key = get_material_key(board, BLACK);
+
+    for (int i = 0; i < tablebase_count; i++) {
+        Tablebase *tb = &tablebases[i];
+        bool flip = tb->white_key == black_key && tb->black_key == white_key;
+
+        if (!tb->dtm ||
+            (!flip && (tb->white_key != white_key ||
+                       tb->black_key != black_key))) {
+            continue;
+        }
+
+        // Tables have the stronger side as white, so flip colors if black
+        // is stronger
+        Bitboard used = 0;
+        for (int j = 0; j < tb->count; j++) {
+            int piece = flip ? tb->pieces[j] ^ 8 : tb->pieces[j];
+            int square = get_lsb(board->pieces[piece] & ~used);
+
+            set_bit(&used, square);
+            squares[j] = flip ? square ^ 56 : square;
+        }
+
+        canonicalize(tb, squares);
+        *index = get_index(tb, squares, board->player ^ flip);
+        *table = tb;
+        return true;
+    }
+
+    return false;
+}
+
+// Test if the side to move can capture enpassant
+static inline bool enpassant_possible(const Board *board) {
+    int square = board->state[board->ply].enpassant;
+    Bitboard attackers = 0;
+
+    if (square == NO_SQUARE) {
+        return false;
+    }
+
+    int pushed = board->player == WHITE ? square - 8 : square + 8;
+    if ((square & 7) > 0) {
+        set_bit(&attackers, pushed - 1);
+    }
+    if ((square & 7) < 7) {
+        set_bit(&attackers, pushed + 1);
+    }
+
+    return attackers & board->pieces[make_piece(PAWN, board->player)];
+}
+
+// Count pieces of each type except the king in 4 bits per type
+static inline int get_material_key(const Board *board, int color) {
+    int key = 0;
+
+    for (int piece = PAWN; piece <= QUEEN; piece++) {
+        key += get_population(board->pieces[make_piece(piece, color)])
+               << (4 * piece);
+    }
+    return key;
+}
+
+// Get distance to mate value of a position
+static inline bool read_dtm(const Board *board, int *value) {
+    Tablebase *tb;
+    U64 index;
+
+    // Bare kings are always a draw
+    if (get_population(board->occupancies[2]) == 2) {
+        *value = 0;
+        return true;
+    }
+
+    if (!find_position(board, &tb, &index)) {
+        return false;
+    }
+
+    *value = tb->dtm[index];
+    return *value != BROKEN;
+}
+
+// Convert distance to mate value to a mate score for the side to move
+static inline int value_score(int value) {
+    return value == 0         ? DRAW_SCORE
+           : (value - 1) & 1 ? INFINITY - (value - 1)
+                             : -INFINITY + (value - 1);
+}
+
+// Convert mate score of a position after a move to the score before it
+static inline int child_score(int score) {
+    return score > 0 ? -score + 1 : score < 0 ? -score - 1 : DRAW_SCORE;
+}
+
+// Follow the fastest win or the slowest loss until mate
+static int get_tablebase_pv(Board *board, Move *pv_moves, int max_length) {
+    Move moves[MAX_MOVES], best_move = NULL_MOVE;
+    int score, best_score = -INFINITY - 1;
+
+    if (!max_length || !probe_dtm(board, &score) || score == DRAW_SCORE) {
+        return 0;
+    }
+
+    int count = generate_legal_moves(board, moves);
+    for (int i = 0; i < count; i++) {
+        make_move(board, moves[i]);
+        if (probe_dtm(board, &score) && child_score(score) > best_score) {
+            best_score = child_score(score);
+            best_move = moves[i];
+        }
+        unmake_move(board, moves[i]);
+    }
+
+    if (best_move == NULL_MOVE) {
+        return 0;
+    }
+
+    pv_moves[0] = best_move;
+    make_move(board, best_move);
+    int length = 1 + get_tablebase_pv(board, pv_moves + 1, max_length - 1);
+    unmake_move(board, best_move);
+
+    return length;
+}
+
+// Transform squares by symmetry so that equivalent positions share an index
+static void canonicalize(const Tablebase *tb, int *squares) {
+    int flipped[TABLEBASE_PIECES];
+
+    if ((squares[0] & 7) > 3) {
+        for (int i = 0; i < tb->count; i++) {
+            squares[i] ^= 7;
+        }
+    }
+
+    if (!tb->pawns) {
+        if ((squares[0] >> 3) > 3) {
+            for (int i = 0; i < tb->count; i++) {
+                squares[i] ^= 56;
+            }
+        }
+        if ((squares[0] >> 3) > (squares[0] & 7)) {
+            for (int i = 0; i < tb->count; i++) {
+                squares[i] = flip_diagonal(squares[i]);
+            }
+        }
+    }
+
+    sort_squares(tb, squares);
+
+    // White king on the diagonal can be flipped, so take the smaller squares
+    if (!tb->pawns && (squares[0] >> 3) == (squares[0] & 7)) {
+        for (int i = 0; i < tb->count; i++) {
+            flipped[i] = flip_diagonal(squares[i]);
+        }
+        sort_squares(tb, flipped);
+
+        for (int i = 1; i < tb->count; i++) {
+            if (flipped[i] != squares[i]) {
+                if (flipped[i] < squares[i]) {
+                    memcpy(squares, flipped, sizeof(flipped));
+                }
+                break;
+            }
+        }
+    }
+}
+
+// Sort squares of identical pieces
+static inline void sort_squares(const Tablebase *tb, int *squares) {
+    for (int i = 1; i < tb->count; i++) {
+        for (int j = i; j > 0 && tb->pieces[j] == tb->pieces[j - 1] &&
+                        squares[j] < squares[j - 1];
+             j--) {
+            int square = squares[j];
+            squares[j] = squares[j - 1];
+            squares[j - 1] = square;
+        }
+    }
+}
+
+// Mirror square along the a1-h8 diagonal
+static inline int flip_diagonal(int square) {
+    return ((square & 7) << 3) | (square >> 3);
+}
+
+// Get index of canonical squares
+static inline U64 get_index(const Tablebase *tb, const int *squares,
+                            int player) {
+    U64 index;
+
+    if (tb->pawns) {
+        index = player * 32 + (squares[0] >> 3) * 4 + (squares[0] & 7);
+    } else {
+        index = player * 10 + king_slots[squares[0]];
+    }
+
+    for (int i = 1; i < tb->count; i++) {
+        index = index * 64 + squares[i];
+    }
+    return index;
+}
+
+// Get squares and side to move of an index, or return false if the
+// position is invalid or not canonical
+static bool decode_index(const Tablebase *tb, U64 index, int *squares,
+                         int *player) {
+    int canonical[TABLEBASE_PIECES];
+    Bitboard used = 0;
+
+    for (int i = tb->count - 1; i > 0; i--) {
+        squares[i] = index % 64;
+        index /= 64;
+    }
+
+    int slots = tb->pawns ? 32 : 10;
+    int slot = index % slots;
+    *player = index / slots;
+    squares[0] = tb->pawns ? make_square(slot & 3, slot >> 2) : triangle[slot];
+
+    for (int i = 0; i < tb->count; i++) {
+        int rank = squares[i] >> 3;
+
+        if (get_bit(used, squares[i]) ||
+            (get_piece_type(tb->pieces[i]) == PAWN &&
+             (rank == 0 || rank == 7))) {
+            return false;
+        }
+        set_bit(&used, squares[i]);
+    }
+
+    memcpy(canonical, squares, sizeof(canonical));
+    canonicalize(tb, canonical);
+    return !memcmp(canonical, squares, tb->count * sizeof(int));
+}
+
+// Set up board with only the pieces of a table
+static void set_position(Board *board, const Tablebase *tb,
+                         const int *squares, int player) {
+    memset(board->pieces, 0, sizeof(board->pieces));
+    memset(board->occupancies, 0, sizeof(board->occupancies));
+    for (int square = A1; square <= H8; square++) {
+        board->board[square] = NO_PIECE;
+    }
+
+    for (int i = 0; i < tb->count; i++) {
+        toggle_piece(board, tb->pieces[i], squares[i]);
+        board->board[squares[i]] = tb->pieces[i];
+    }
+
+    board->ply = 0;
+    board->player = player;
+    board->state[0] = (State){.capture = NO_PIECE, .enpassant = NO_SQUARE};
+}
+
+// Add or remove piece from the bitboards
+static inline void toggle_piece(Board *board, int piece, int square) {
+    flip_bit(&board->pieces[piece], square);
+    flip_bit(&board->occupancies[get_piece_color(piece)], square);
+    flip_bit(&board->occupancies[2], square);
+}
+
+// Generate one table with retrograde analysis. Mates are propagated
+// backwards one ply at a time, a position is won once any move leads to a
+// lost position and lost once all moves lead to won positions. Captures and
+// promotions leave the table and are probed in smaller tables.
+static void generate_tablebase(Tablebase *tb, const char *path) {
+    static Board board;
+    Bucket buckets[MAX_DISTANCE] = {{0}};
+
+    uint8_t *values = calloc(tb->size, 1);
+    uint8_t *counters = calloc(tb->size, 1);
+    uint8_t *exit_wins = calloc(tb->size, 1);
+    uint8_t *exit_losses = calloc(tb->size, 1);
+    if (!values || !counters || !exit_wins || !exit_losses) {
+        fprintf(stderr, "Error: %s failed to allocate\n", tb->name);
+        exit(1);
+    }
+
+    init_board(&board);
+    for (U64 index = 0; index < tb->size; index++) {
+        init_position(tb, &board, index, values, counters, exit_wins,
+                      exit_losses, buckets);
+    }
+
+    for (int distance = 0; distance < MAX_DISTANCE; distance++) {
+        Bucket *bucket = &buckets[distance];
+
+        for (size_t i = 0; i < bucket->count; i++) {
+            U64 index = bucket->indices[i] & ~EXIT_FLAG;
+
+            // Win by leaving the table, unless a faster win is known
+            if (bucket->indices[i] & EXIT_FLAG) {
+                if (values[index]) {
+                    continue;
+                }
+                values[index] = distance + 1;
+            }
+
+            propagate(tb, &board, index, distance, values, counters,
+                      exit_wins, exit_losses, buckets);
+        }
+        free(bucket->indices);
+    }
+
+    write_tablebase(tb, path, values);
+
+    free(values);
+    free(counters);
+    free(exit_wins);
+    free(exit_losses);
+}
+
+// Find mates, stalemates, and moves leaving the table, and count moves
+// staying in the table
+static void init_position(Tablebase *tb, Board *board, U64 index,
+                          uint8_t *values, uint8_t *counters,
+                          uint8_t *exit_wins, uint8_t *exit_losses,
+                          Bucket *buckets) {
+    int squares[TABLEBASE_PIECES], child[TABLEBASE_PIECES], player;
+    U64 children[MAX_MOVES];
+    Move moves[MAX_MOVES];
+    int child_count = 0, exit_win = 0, exit_loss = 0;
+
+    // Invalid positions and positions where the king can be captured
+    if (!decode_index(tb, index, squares, &player)) {
+        values[index] = BROKEN;
+        return;
+    }
+    set_position(board, tb, squares, player);
+    if (in_check(board, !player)) {
+        values[index] = BROKEN;
+        return;
+    }
+
+    // Checkmate is lost now, stalemate is a draw
+    int count = generate_legal_moves(board, moves);
+    if (!count) {
+        if (in_check(board, player)) {
+            values[index] = 1;
+            push_bucket(&buckets[0], index);
+        }
+        return;
+    }
+
+    for (int i = 0; i < count; i++) {
+        Move move = moves[i];
+        bool leaves = board->board[get_move_end(move)] != NO_PIECE ||
+                    get_move_flag(move) == PROMOTION;
+        int value;
+
+        make_move(board, move);
+
+        // Enpassant is not part of the tables, so a double push that the
+        // opponent wins by capturing enpassant leaves the table. The loss
+        // is then too long if the opponent mates faster without capturing.
+        if (!leaves && read_enpassant(board, &value) && value &&
+            (value - 1) & 1) {
+            leaves = true;
+        } else if (leaves && !read_dtm(board, &value)) {
+            fprintf(stderr, "Error: table for %s is missing\n", tb->name);
+            exit(1);
+        }
+
+        if (leaves) {
+            // Distance after leaving the table, draws are marked by 255
+            if (value == 0) {
+                exit_loss = BROKEN;
+            } else if ((value - 1) & 1) {
+                if (exit_loss != BROKEN) {
+                    exit_loss = MAX(exit_loss, value);
+                }
+            } else {
+                exit_win = exit_win ? MIN(exit_win, value) : value;
+            }
+        } else {
+            // Count each position in the table once
+            Bitboard used = 0;
+            for (int j = 0; j < tb->count; j++) {
+                child[j] =
+                    get_lsb(board->pieces[tb->pieces[j]] & ~used);
+                set_bit(&used, child[j]);
+            }
+            canonicalize(tb, child);
+            U64 child_index = get_index(tb, child, !player);
+
+            bool found = false;
+            for (int j = 0; j < child_count && !found; j++) {
+                found = children[j] == child_index;
+            }
+            if (!found) {
+                children[child_count++] = child_index;
+            }
+        }
+
+        unmake_move(board, move);
+    }
+
+    counters[index] = child_count;
+    exit_wins[index] = exit_win;
+    exit_losses[index] = exit_loss;
+
+    if (exit_win) {
+        push_bucket(&buckets[exit_win], index | EXIT_FLAG);
+    } else if (!child_count && exit_loss != BROKEN) {
+        values[index] = exit_loss + 1;
+        push_bucket(&buckets[exit_loss], index);
+    }
+}
+
+// Update positions that lead to a position with a known distance to mate
+static void propagate(Tablebase *tb, Board *board, U64 index, int distance,
+                      uint8_t *values, uint8_t *counters, uint8_t *exit_wins,
+                      uint8_t *exit_losses, Bucket *buckets) {
+    int squares[TABLEBASE_PIECES], enpassants[MAX_MOVES], player, value;
+    U64 predecessors[MAX_MOVES];
+
+    decode_index(tb, index, squares, &player);
+    set_position(board, tb, squares, player);
+
+    int count = get_predecessors(tb, board, squares, player, predecessors,
+                                 enpassants);
+    for (int i = 0; i < count; i++) {
+        U64 predecessor = predecessors[i];
+        int plies = distance;
+
+        if (values[predecessor]) {
+            continue;
+        }
+
+        // After a double push the side to move can also capture enpassant
+        if (enpassants[i] != NO_SQUARE) {
+            board->state[0].enpassant = enpassants[i];
+            bool found = read_enpassant(board, &value);
+            board->state[0].enpassant = NO_SQUARE;
+
+            if (found) {
+                // Won captures were counted as leaving the table, drawn
+                // captures keep the push from winning
+                if ((value && (value - 1) & 1) ||
+                    (!(distance & 1) && !value)) {
+                    continue;
+                }
+                if (!(distance & 1)) {
+                    plies = MAX(distance, value - 1);
+                }
+            }
+        }
+
+        if (!(distance & 1)) {
+            // Any move to a lost position wins
+            if (plies + 1 >= MAX_DISTANCE) {
+                fprintf(stderr, "Error: %s is too deep\n", tb->name);
+                exit(1);
+            }
+
+            // A slower loss by capturing enpassant wins later
+            if (plies > distance) {
+                push_bucket(&buckets[plies + 1], predecessor | EXIT_FLAG);
+            } else {
+                values[predecessor] = distance + 2;
+                push_bucket(&buckets[distance + 1], predecessor);
+            }
+        } else if (!--counters[predecessor] && !exit_wins[predecessor] &&
+                   exit_losses[predecessor] != BROKEN) {
+            // All moves lead to won positions
+            int loss = MAX(distance + 1, exit_losses[predecessor]);
+            if (loss >= MAX_DISTANCE) {
+                fprintf(stderr, "Error: %s is too deep\n", tb->name);
+                exit(1);
+            }
+            values[predecessor] = loss + 1;
+            push_bucket(&buckets[loss], predecessor);
+        }
+    }
+}
+
+// Get indices of legal positions before a move of the side not to move,
+// captures are excluded since the position before has more pieces. The
+// enpassant square is set for double pushes, otherwise it is NO_SQUARE.
+static inline int get_predecessors(const Tablebase *tb, Board *board,
+                                   const int *squares, int player,
+                                   U64 *predecessors, int *enpassants) {
+    int previous[TABLEBASE_PIECES], count = 0;
+
+    for (int i = 0; i < tb->count; i++) {
+        int piece = tb->pieces[i], square = squares[i];
+        Bitboard targets = 0;
+
+        if (get_piece_color(piece) == player) {
+            continue;
+        }
+
+        if (get_piece_type(piece) == PAWN) {
+            int back = player == BLACK ? square - 8 : square + 8;
+            int rank = square >> 3;
+
+            if (back >= A2 && back <= H7 &&
+                !get_bit(board->occupancies[2], back)) {
+                set_bit(&targets, back);
+
+                int back2 = player == BLACK ? square - 16 : square + 16;
+                if (rank == (player == BLACK ? 3 : 4) &&
+                    !get_bit(board->occupancies[2], back2)) {
+                    set_bit(&targets, back2);
+                }
+            }
+        } else {
+            targets = get_attacks(board, square, get_piece_type(piece)) &
+                      ~board->occupancies[2];
+        }
+
+        while (targets) {
+            int target = pop_lsb(&targets);
+
+            // Side to move can not be in check before the move
+            toggle_piece(board, piece, square);
+            toggle_piece(board, piece, target);
+            bool legal = !in_check(board, player);
+            toggle_piece(board, piece, target);
+            toggle_piece(board, piece, square);
+            if (!legal) {
+                continue;
+            }
+
+            memcpy(previous, squares, sizeof(previous));
+            previous[i] = target;
+            canonicalize(tb, previous);
+            U64 predecessor = get_index(tb, previous, !player);
+            int enpassant = get_piece_type(piece) == PAWN &&
+                                    (target ^ square) == 16
+                                ? (target + square) / 2
+                                : NO_SQUARE;
+
+            // Keep the move without enpassant if both lead here
+            int j = 0;
+            while (j < count && predecessors[j] != predecessor) {
+                j++;
+            }
+            if (j == count) {
+                predecessors[count] = predecessor;
+                enpassants[count++] = enpassant;
+            } else if (enpassant == NO_SQUARE) {
+                enpassants[j] = NO_SQUARE;
+            }
+        }
+    }
+
+    return count;
+}
+
+// Get distance to mate value of a position when only the enpassant
+// captures are played, or return false if there are none
+static bool read_enpassant(Board *board, int *value) {
+    Move moves[MAX_MOVES];
+    bool found = false;
+
+    if (!enpassant_possible(board)) {
+        return false;
+    }
+
+    int count = generate_legal_moves(board, moves);
+    for (int i = 0; i < count; i++) {
+        int child;
+
+        if (get_move_flag(moves[i]) != ENPASSANT) {
+            continue;
+        }
+
+        make_move(board, moves[i]);
+        if (!read_dtm(board, &child)) {
+            fprintf(stderr, "Error: table after enpassant is missing\n");
+            exit(1);
+        }
+        unmake_move(board, moves[i]);
+
+        // One more ply than after the capture
+        child = child ? child + 1 : 0;
+        if (!found || value_score(child) > value_score(*value)) {
+            *value = child;
+            found = true;
+        }
+    }
+
+    return found;
+}
+
+// Append index to a bucket
+static inline void push_bucket(Bucket *bucket, uint32_t index) {
+    if (bucket->count == bucket->capacity) {
+        bucket->capacity = MAX(bucket->capacity * 2, 1024);
+        bucket->indices =
+            realloc(bucket->indices, bucket->capacity * sizeof(uint32_t));
+        if (!bucket->indices) {
+            fprintf(stderr, "Error: tablebase bucket failed to allocate\n");
+            exit(1);
+        }
+    }
+    bucket->indices[bucket->count++] = index;
+}
+
+// Write distance to mate and win/draw/loss files of a table
+static void write_tablebase(const Tablebase *tb, const char *path,
+                            const uint8_t *values) {
+    char file[4096];
+    U64 wdl_size = (tb->size + 3) / 4;
+    uint8_t *wdl = calloc(wdl_size, 1);
+
+    if (!wdl) {
+        fprintf(stderr, "Error: %s failed to allocate\n", tb->name);
+        exit(1);
+    }
+
+    for (U64 index = 0; index < tb->size; index++) {
+        int value = values[index];
+        int bits = value == BROKEN ? 3
+                   : value == 0    ? 0
+                   : (value - 1) & 1 ? 1
+                                     : 2;
+        wdl[index >> 2] |= bits << ((index & 3) * 2);
+    }
+
+    snprintf(file, sizeof(file), "%s/%s.dtm", path, tb->name);
+    FILE *dtm_file = fopen(file, "wb");
+    snprintf(file, sizeof(file), "%s/%s.wdl", path, tb->name);
+    FILE *wdl_file = fopen(file, "wb");
+    if (!dtm_file || !wdl_file ||
+        fwrite(values, 1, tb->size, dtm_file) != tb->size ||
+        fwrite(wdl, 1, wdl_size, wdl_file) != wdl_size) {
+        fprintf(stderr, "Error: %s failed to write\n", tb->name);
+        exit(1);
+    }
+
+    fclose(dtm_file);
+    fclose(wdl_file);
+    free(wdl);
+}
@@ -0,0 +1,110 @@
+#include "time_manager.h"
+
+#define MOVE_OVERHEAD 10
+#define MAX_MOVES_TO_GO 50
+#define MIN_MOVES_TO_GO 20
+#define MAXIMUM_RATIO 5
+#define MAXIMUM_CLOCK 0.8
+#define STABILITY_SCALE 0.1
+#define MAX_STABILITY 6
+
+// Time in milliseconds lost to communication with the GUI every move
+int move_overhead = MOVE_OVERHEAD;
+
+static volatile U64 start_time;
+static double optimum_time;
+static double maximum_time;
+static bool time_limit;
+static bool fixed_time;
+static volatile bool pondering;
+
+// Calculate optimum and maximum time to search from the clock
+void init_time_manager(const Parameter *parameters, int player) {
+    double time = player == WHITE ? parameters->white_time
+                                  : parameters->black_time;
+    double increment = player == WHITE ? parameters->white_increment
+                                       : parameters->black_increment;
+
+    start_time = parameters->start_time;
+    time_limit = fixed_time = false;
+
+    if (parameters->infinite) {
+        return;
+    }
+
+    // Search for exactly the given time
+    if (parameters->move_time) {
+        time_limit = fixed_time = true;
+        maximum_time = MAX((double)parameters->move_time - move_overhead, 1);
+        optimum_time = maximum_time;
+        return;
+    }
+
+    if (!time && !increment) {
+        return;
+    }
+    time_limit = true;
+
+    // Estimate moves left in sudden death from the length of the game
+    int moves_to_go = parameters->moves_to_go
+                          ? MIN(parameters->moves_to_go, MAX_MOVES_TO_GO)
+                          : MAX(MAX_MOVES_TO_GO - game_ply / 4,
+                                MIN_MOVES_TO_GO);
+
+    // Split time and future increments over the remaining moves after
+    // reserving the overhead of each move
+    double time_left = time + increment * (moves_to_go - 1) -
+                       move_overhead * (moves_to_go + 2);
+    optimum_time = MAX(time_left, 1) / moves_to_go;
+
+    // Hard limit allows longer searches but never uses most of the clock
+    maximum_time = MIN(optimum_time * MAXIMUM_RATIO,
+                       time * MAXIMUM_CLOCK - move_overhead);
+    maximum_time = MAX(maximum_time, 1);
+    optimum_time = MIN(optimum_time, maximum_time);
+}
+
+// Check if another iteration should be started using best move stability
+bool stop_iterating(int stability) {
+    if (!time_limit || pondering) {
+        return false;
+    }
+
+    double elapsed_time = get_time() - start_time;
+    if (fixed_time) {
+        return elapsed_time >= optimum_time;
+    }
+
+    // Use more time when the best move changes and less when it is stable
+    int unstable = MAX_STABILITY / 2 - MIN(stability, MAX_STABILITY);
+    double scale = 1 + STABILITY_SCALE * unstable;
+
+    // The next iteration takes about as long as all previous iterations, so
+    // do not start one that would end after the optimum time
+    return 2 * elapsed_time >= optimum_time * scale;
+}
+
+// Check if the hard time limit is reached
+bool time_over() {
+    return time_limit && !pondering &&
+           get_time() - start_time >= maximum_time;
+}
+
+// Check if a share of the optimum time is used, for searches that run
+// before the normal search
+bool optimum_time_over(double share) {
+    return time_limit && !pondering &&
+           get_time() - start_time >= optimum_time * share;
+}
+
+// Ignore time limits while searching on the time of the opponent
+void set_pondering(bool ponder) { pondering = ponder; }
+
+// Start the clock when the opponent plays the expected move
+void ponder_hit() {
+    start_time = get_time();
+    pondering = false;
+}
+
+// Check if the search is on the time of the opponent
+bool is_pondering() { return pondering; }
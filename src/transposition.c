@@ -1,85 +1,310 @@
+// Huge pages and memory policies are extensions to C99 and POSIX
+#define _DEFAULT_SOURCE
+
 #include "transposition.h"
+#include "attacks.h"
 #include "move.h"
 
+#if defined(__linux__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#endif
+
+#define CLUSTER_SIZE 6
+#define BOUND_MASK 3
+#define GENERATION_DELTA 4
+#define AGE_WEIGHT 8
+#define HUGE_PAGE_SIZE (UINT64_C(1) << 21)
+#define MPOL_INTERLEAVE 3
+#define MAX_CLEAR_THREADS 64
+#define HASH_FILE_MAGIC "CHESSTT2"
+
+// Entries sharing one 64 byte cache line, which is selected by the upper
+// bits of the hash. Each entry is packed into a 64 bit data word, and its
+// key is the lower 16 bits of the hash xored with the folded data. Threads
+// write without locks, so an entry torn by two writes fails the key check
+// and is treated as a miss.
+typedef struct cluster {
+    U64 data[CLUSTER_SIZE];
+    uint16_t keys[CLUSTER_SIZE];
+    char padding[64 - CLUSTER_SIZE * (sizeof(U64) + sizeof(uint16_t))];
+} Cluster;
+
+// Header of a saved table followed by its clusters, padded to a cache line
+// so that the clusters of a mapped file stay aligned
+typedef struct hashHeader {
+    char magic[8];
+    U64 key_seed;
+    U64 cluster_count;
+    uint8_t generation;
+    char padding[64 - 3 * sizeof(U64) - sizeof(uint8_t)];
+} HashHeader;
+
 U64 piece_key[16][64];
 U64 castling_key[16];
 U64 enpassant_key[64 + 1];
 U64 side_key;
 
-static Transposition *transposition = NULL;
-static U64 transposition_size;
-
-static void init_hash_keys();
+// Cuckoo tables of reversible moves indexed by the hash difference
+static U64 cuckoo_keys[16384];
+static Move cuckoo_moves[16384];
+
+// Slice of the table cleared by one thread
+typedef struct slice {
+    pthread_t tid;
+    Cluster *start;
+    U64 count;
+} Slice;
+
+static void *memory = NULL;
+static U64 memory_size;
+static Cluster *clusters = NULL;
+static U64 cluster_count;
+static uint8_t generation;
+static Slice slices[MAX_CLEAR_THREADS];
+static int slice_count = 0;
+
+static inline Cluster *get_cluster(U64 hash);
+static inline uint16_t get_key(U64 hash);
+static inline bool read_entry(Cluster *cluster, int index, uint16_t key,
+                              Transposition *entry);
+static inline void write_entry(Cluster *cluster, int index, uint16_t key,
+                               const Transposition *entry);
+static inline U64 load_data(const U64 *data);
+static inline void store_data(U64 *data, U64 value);
+static inline bool find_entry(U64 hash, Transposition *entry);
+static inline int replace_entry(U64 hash, Transposition *entry, bool *same);
+static inline int get_age(int flag);
+static void *allocate_memory(U64 size);
+static U64 get_key_seed();
+static bool check_header(const HashHeader *header, U64 size,
+                         const char *path);
+static void *clear_slice(void *argument);
+static void init_cuckoo();
+static inline int cuckoo_index(U64 key, int table);
 static void print_pv_moves(Board *board);
 
 // Initialize transposition table
 void init_transposition(int megabytes) {
-    init_hash_keys();
-
-    // Round megabytes down to previous power of 2
+    // Any size is used fully since clusters are not indexed by a bit mask
     if (megabytes <= 0) {
         megabytes = 1;
-    } else if ((megabytes & (megabytes - 1)) != 0) {
-        megabytes |= megabytes >> 1;
-        megabytes |= megabytes >> 2;
-        megabytes |= megabytes >> 4;
-        megabytes |= megabytes >> 8;
-        megabytes |= megabytes >> 16;
-        megabytes -= megabytes >> 1;
     }
 
-    transposition_size =
-        (U64)megabytes * UINT64_C(0x100000) / sizeof(Transposition);
+    cluster_count = (U64)megabytes * UINT64_C(0x100000) / sizeof(Cluster);
 
     // Free memory if it is already allocated
-    if (transposition != NULL) {
-        free(transposition);
-    }
+    free_transposition();
 
-    // Dynamically allocate transposition array
-    transposition = calloc(transposition_size, sizeof(Transposition));
-    if (transposition == NULL) {
+    // Dynamically allocate zeroed clusters aligned to cache lines
+    memory = allocate_memory(cluster_count * sizeof(Cluster));
+    if (memory == NULL) {
         fprintf(stderr, "Error: transposition table failed to allocate\n");
         exit(1);
     }
+    clusters = (Cluster *)(((uintptr_t)memory + 63) & ~(uintptr_t)63);
+    generation = 0;
 }
 
-// Clear transposition table
+// Clear transposition table in the background with one thread per core,
+// the next search waits until it is done
 void clear_transposition() {
-    memset(transposition, 0, transposition_size * sizeof(Transposition));
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    int count = (int)MIN(MAX(cores, 1), MAX_CLEAR_THREADS);
+
+    wait_transposition();
+    generation = 0;
+
+    for (int i = 0; i < count; i++) {
+        Slice *slice = &slices[slice_count];
+        U64 start = cluster_count * i / count;
+
+        slice->start = clusters + start;
+        slice->count = cluster_count * (i + 1) / count - start;
+
+        // Clear slice directly if no thread can be created
+        if (pthread_create(&slice->tid, NULL, clear_slice, slice)) {
+            clear_slice(slice);
+        } else {
+            slice_count++;
+        }
+    }
+}
+
+// Wait for the table to be cleared
+void wait_transposition() {
+    for (int i = 0; i < slice_count; i++) {
+        pthread_join(slices[i].tid, NULL);
+    }
+    slice_count = 0;
 }
 
 // Free dynamically allocated memory
 void free_transposition() {
-    if (transposition) {
-        free(transposition);
+    wait_transposition();
+
+    if (memory) {
+#if defined(__linux__)
+        munmap(memory, memory_size);
+#else
+        free(memory);
+#endif
+        memory = NULL;
+        clusters = NULL;
+    }
+}
+
+// Save table with a header to a file, so that a later analysis can continue
+// with it
+bool save_transposition(const char *path) {
+    HashHeader header = {HASH_FILE_MAGIC, get_key_seed(), cluster_count,
+                         generation, {0}};
+    FILE *file;
+
+    wait_transposition();
+    file = fopen(path, "wb");
+    if (!file ||
+        fwrite(&header, sizeof(header), 1, file) != 1 ||
+        fwrite(clusters, sizeof(Cluster), cluster_count, file) !=
+            cluster_count) {
+        fprintf(stderr, "Error: %s failed to write\n", path);
+        if (file) {
+            fclose(file);
+        }
+        return false;
     }
+
+    return !fclose(file);
+}
+
+// Load table saved with the same hash keys, which replaces the current table
+// and its size. The file is mapped privately, so the table is usable
+// immediately while pages are read in as they are probed, and changes are
+// not written back.
+bool load_transposition(const char *path) {
+    HashHeader header;
+
+#if defined(__linux__)
+    struct stat status;
+    int file = open(path, O_RDONLY);
+
+    if (file < 0 || fstat(file, &status) ||
+        read(file, &header, sizeof(header)) != sizeof(header)) {
+        fprintf(stderr, "Error: %s failed to load\n", path);
+        if (file >= 0) {
+            close(file);
+        }
+        return false;
+    }
+    if (!check_header(&header, status.st_size, path)) {
+        close(file);
+        return false;
+    }
+
+    void *data = mmap(NULL, status.st_size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE, file, 0);
+    close(file);
+    if (data == MAP_FAILED) {
+        fprintf(stderr, "Error: %s failed to load\n", path);
+        return false;
+    }
+#if defined(MADV_WILLNEED)
+    madvise(data, status.st_size, MADV_WILLNEED);
+#endif
+
+    free_transposition();
+    memory = data;
+    memory_size = status.st_size;
+    clusters = (Cluster *)((char *)data + sizeof(header));
+#else
+    FILE *file = fopen(path, "rb");
+    long size = -1;
+
+    // Read the whole table without memory mapping
+    if (file && !fseek(file, 0, SEEK_END)) {
+        size = ftell(file);
+        rewind(file);
+    }
+    if (!file || size < 0 || fread(&header, sizeof(header), 1, file) != 1) {
+        fprintf(stderr, "Error: %s failed to load\n", path);
+        if (file) {
+            fclose(file);
+        }
+        return false;
+    }
+    if (!check_header(&header, size, path)) {
+        fclose(file);
+        return false;
+    }
+
+    free_transposition();
+    memory = allocate_memory(header.cluster_count * sizeof(Cluster));
+    if (memory == NULL) {
+        fprintf(stderr, "Error: transposition table failed to allocate\n");
+        exit(1);
+    }
+    clusters = (Cluster *)(((uintptr_t)memory + 63) & ~(uintptr_t)63);
+    if (fread(clusters, sizeof(Cluster), header.cluster_count, file) !=
+        header.cluster_count) {
+        fprintf(stderr, "Error: %s failed to load\n", path);
+        memset(clusters, 0, header.cluster_count * sizeof(Cluster));
+    }
+    fclose(file);
+#endif
+
+    cluster_count = header.cluster_count;
+    generation = header.generation;
+    return true;
+}
+
+// Start a new search, entries of older searches are replaced first
+void age_transposition() {
+    wait_transposition();
+    generation += GENERATION_DELTA;
+}
+
+// Load the cluster of a position into the cache before it is probed
+void prefetch_transposition(U64 hash) {
+#if defined(__GNUC__)
+    __builtin_prefetch(get_cluster(hash));
+#else
+    (void)hash;
+#endif
 }
 
 // Check transposition table to see if position has already been searched
 int get_transposition(U64 hash, int alpha, int beta, int ply, int depth,
-                      Move *move) {
-    Transposition *entry = &transposition[hash & (transposition_size - 1)];
+                      Move *move, int *eval, TTStats *stats) {
+    Transposition entry;
 
-    if (entry->hash == hash) {
-        *move = entry->move;
+    stats->probes++;
+    *eval = INVALID_SCORE;
+    if (find_entry(hash, &entry)) {
+        int flag = entry.flag & BOUND_MASK;
+
+        stats->hits++;
+        *move = entry.move;
+        *eval = entry.eval;
 
         // Only retrieve entries with sufficient depth
-        if (entry->depth >= depth) {
-            int score = entry->score;
+        if (entry.depth >= depth) {
+            int score = entry.score;
+            stats->depth_hits++;
 
             // Adjust mate score based off of the root node
             if (is_mate_score(score)) {
                 score += (score > 0) ? -ply : ply;
             }
 
-            if (entry->flag == EXACT_BOUND) {
+            if (flag == EXACT_BOUND) {
                 return score;
             }
-            if (entry->flag == UPPER_BOUND && score <= alpha) {
+            if (flag == UPPER_BOUND && score <= alpha) {
                 return alpha;
             }
-            if (entry->flag == LOWER_BOUND && score >= beta) {
+            if (flag == LOWER_BOUND && score >= beta) {
                 return beta;
             }
         }
@@ -88,47 +313,80 @@ int get_transposition(U64 hash, int alpha, int beta, int ply, int depth,
     return INVALID_SCORE;
 }
 
+// Get copy of transposition table entry with score relative to the node and
+// only the bound in the flag
+bool probe_transposition(U64 hash, int ply, Transposition *entry) {
+    if (!find_entry(hash, entry)) {
+        return false;
+    }
+
+    entry->flag &= BOUND_MASK;
+
+    // Adjust mate score based off of the root node
+    if (is_mate_score(entry->score)) {
+        entry->score += (entry->score > 0) ? -ply : ply;
+    }
+
+    return true;
+}
+
 // Save position and score to transposition table
-void set_transposition(U64 hash, int score, int flag, int ply, int depth,
-                       Move move) {
-    Transposition *entry = &transposition[hash & (transposition_size - 1)];
+void set_transposition(U64 hash, int score, int eval, int flag, int ply,
+                       int depth, Move move, TTStats *stats) {
+    Transposition entry;
+    bool same;
+    int index = replace_entry(hash, &entry, &same);
 
     // Adjust mate score based off of the root node
     if (is_mate_score(score)) {
         score += (score > 0) ? ply : -ply;
     }
 
-    // Replace entry if entry is different or lower depth
-    if (entry->hash != hash || entry->depth <= depth) {
-        entry->hash = hash;
-        entry->move = move;
-        entry->score = score;
-        // entry->age = game_ply;
-        entry->depth = depth;
-        entry->flag = flag;
+    // Replace entry if entry is different, lower depth, or from an older
+    // search
+    if (!same || entry.depth <= depth || get_age(entry.flag)) {
+        // Keep best move of the same position if no move raised alpha
+        if (move != NULL_MOVE || !same) {
+            entry.move = move;
+        }
+
+        // Count entries of other positions that are overwritten
+        if (!same && (entry.flag & BOUND_MASK)) {
+            stats->replacements++;
+        }
+
+        entry.score = score;
+        entry.eval = eval;
+        entry.depth = depth;
+        entry.flag = generation | flag;
+        write_entry(get_cluster(hash), index, get_key(hash), &entry);
     }
 }
 
 // Save principal variation moves to transposition table
-void set_pv_moves(Board *board, Stack *stack, int score) {
-    Transposition *entry;
-    Move *pv_moves = stack->pv_moves;
-    int length = stack->pv_length;
+void set_pv_moves(Board *board, Move *pv_moves, int length, int score) {
+    Transposition entry;
+    bool same;
 
     for (int i = 0; i < length; i++) {
-        entry = &transposition[board->hash & (transposition_size - 1)];
+        U64 hash = board->hash;
+        int index = replace_entry(hash, &entry, &same);
 
         // Adjust mate score based off of the root node
         if (is_mate_score(score)) {
             score += (score > 0) ? i : -i;
         }
 
-        entry->hash = board->hash;
-        entry->move = pv_moves[i];
-        entry->score = (i & 1) ? -score : score;
-        // entry->age = game_ply;
-        entry->depth = length - i;
-        entry->flag = EXACT_BOUND;
+        // Static evaluation is only known if the position was stored before
+        if (!same) {
+            entry.eval = INVALID_SCORE;
+        }
+
+        entry.move = pv_moves[i];
+        entry.score = (i & 1) ? -score : score;
+        entry.depth = length - i;
+        entry.flag = generation | EXACT_BOUND;
+        write_entry(get_cluster(hash), index, get_key(hash), &entry);
 
         make_move(board, pv_moves[i]);
     }
@@ -140,6 +398,7 @@ void set_pv_moves(Board *board, Stack *stack, int score) {
 
 // Retrieve principal variation from transposition table
 void get_pv_moves(Board *board) {
+    wait_transposition();
     printf("\nBest moves:");
     print_pv_moves(board);
     printf("\n");
@@ -168,8 +427,8 @@ U64 get_hash(Board *board) {
     return hash_key;
 }
 
-// Generate random hash keys for transposition table
-static void init_hash_keys() {
+// Generate random hash keys once, since stored hashes depend on them
+void init_hash_keys() {
     for (int square = A1; square <= H8; square++) {
         for (int piece = PAWN; piece <= KING; piece++) {
             piece_key[piece][square] = rand64();
@@ -184,19 +443,291 @@ static void init_hash_keys() {
     }
 
     side_key = rand64();
+
+    init_cuckoo();
+}
+
+// Get reversible move between two positions from their hash difference
+Move get_cuckoo_move(U64 key) {
+    for (int table = 0; table < 2; table++) {
+        int index = cuckoo_index(key, table);
+        if (cuckoo_keys[index] == key) {
+            return cuckoo_moves[index];
+        }
+    }
+
+    return NULL_MOVE;
+}
+
+// Insert every non pawn move on an empty board into two cuckoo hash tables
+static void init_cuckoo() {
+    static Board board;
+
+    memset(cuckoo_keys, 0, sizeof(cuckoo_keys));
+    memset(cuckoo_moves, 0, sizeof(cuckoo_moves));
+
+    for (int piece = KNIGHT; piece <= KING; piece++) {
+        for (int start = A1; start <= H8; start++) {
+            Bitboard attacks = get_attacks(&board, start, piece);
+
+            for (int end = start + 1; end <= H8; end++) {
+                if (!get_bit(attacks, end)) {
+                    continue;
+                }
+
+                for (int color = WHITE; color <= BLACK; color++) {
+                    int colored_piece = make_piece(piece, color);
+                    Move move = encode_move(start, end, NORMAL_MOVE, KNIGHT);
+                    U64 key = piece_key[colored_piece][start] ^
+                              piece_key[colored_piece][end] ^ side_key;
+
+                    // Move entries to their other slot until one is empty
+                    int index = cuckoo_index(key, 0);
+                    while (true) {
+                        U64 old_key = cuckoo_keys[index];
+                        Move old_move = cuckoo_moves[index];
+                        cuckoo_keys[index] = key;
+                        cuckoo_moves[index] = move;
+
+                        if (old_move == NULL_MOVE) {
+                            break;
+                        }
+
+                        key = old_key;
+                        move = old_move;
+                        index = index == cuckoo_index(key, 0)
+                                    ? cuckoo_index(key, 1)
+                                    : cuckoo_index(key, 0);
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Hash functions of the two cuckoo tables
+static inline int cuckoo_index(U64 key, int table) {
+    return table == 0 ? key & 0x3FFF : (key >> 16) & 0x3FFF;
+}
+
+// Allocate zeroed memory backed by huge pages if possible to avoid TLB
+// misses, and spread it over all NUMA nodes so that threads on every node
+// have the same memory latency
+static void *allocate_memory(U64 size) {
+#if defined(__linux__)
+    unsigned long nodes = ~0UL;
+    void *data = MAP_FAILED;
+
+    memory_size = (size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+
+    // Explicit huge pages are only available if the system reserved them
+#if defined(MAP_HUGETLB)
+    data = mmap(NULL, memory_size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+
+    // Fall back to transparent huge pages
+    if (data == MAP_FAILED) {
+        data = mmap(NULL, memory_size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (data == MAP_FAILED) {
+            return NULL;
+        }
+#if defined(MADV_HUGEPAGE)
+        madvise(data, memory_size, MADV_HUGEPAGE);
+#endif
+    }
+
+    // Interleave pages over the nodes, which fails harmlessly without NUMA
+#if defined(SYS_mbind)
+    syscall(SYS_mbind, data, memory_size, MPOL_INTERLEAVE, &nodes,
+            sizeof(nodes) * 8, 0);
+#else
+    (void)nodes;
+#endif
+
+    return data;
+#else
+    memory_size = size + 63;
+    return calloc(memory_size, 1);
+#endif
+}
+
+// Checksum of the hash keys, since saved entries are only valid for the keys
+// they were stored with
+static U64 get_key_seed() {
+    U64 seed = side_key;
+
+    for (int piece = 0; piece < 16; piece++) {
+        for (int square = A1; square <= H8; square++) {
+            seed = (seed << 7 | seed >> 57) ^ piece_key[piece][square];
+        }
+    }
+    for (int i = 0; i < 16; i++) {
+        seed = (seed << 7 | seed >> 57) ^ castling_key[i];
+    }
+    for (int i = 0; i <= NO_SQUARE; i++) {
+        seed = (seed << 7 | seed >> 57) ^ enpassant_key[i];
+    }
+
+    return seed;
+}
+
+// Check that a saved table matches this engine and the size of its file
+static bool check_header(const HashHeader *header, U64 size,
+                         const char *path) {
+    if (memcmp(header->magic, HASH_FILE_MAGIC, sizeof(header->magic))) {
+        fprintf(stderr, "Error: %s is not a hash file\n", path);
+        return false;
+    }
+    if (header->key_seed != get_key_seed()) {
+        fprintf(stderr, "Error: %s was saved with other hash keys\n", path);
+        return false;
+    }
+    if (!header->cluster_count ||
+        size != sizeof(HashHeader) + header->cluster_count * sizeof(Cluster)) {
+        fprintf(stderr, "Error: %s has the wrong size\n", path);
+        return false;
+    }
+
+    return true;
+}
+
+// Clear one slice of the table
+static void *clear_slice(void *argument) {
+    Slice *slice = argument;
+    memset(slice->start, 0, slice->count * sizeof(Cluster));
+    return NULL;
+}
+
+// Map hash to a cluster with the upper half of the 128 bit product of the
+// hash and the cluster count, which spreads hashes evenly over tables of any
+// size
+static inline Cluster *get_cluster(U64 hash) {
+#if defined(__SIZEOF_INT128__)
+    __extension__ typedef unsigned __int128 U128;
+    return &clusters[(U64)((U128)hash * cluster_count >> 64)];
+#else
+    U64 low = (hash & 0xFFFFFFFF) * (cluster_count & 0xFFFFFFFF);
+    U64 middle1 = (hash >> 32) * (cluster_count & 0xFFFFFFFF);
+    U64 middle2 = (hash & 0xFFFFFFFF) * (cluster_count >> 32);
+    U64 carry = ((low >> 32) + (middle1 & 0xFFFFFFFF) +
+                 (middle2 & 0xFFFFFFFF)) >> 32;
+    return &clusters[(hash >> 32) * (cluster_count >> 32) + (middle1 >> 32) +
+                     (middle2 >> 32) + carry];
+#endif
+}
+
+// Get key stored in entries, the upper bits of the hash select the cluster
+static inline uint16_t get_key(U64 hash) { return (uint16_t)hash; }
+
+// Read an entry, or return false if it is empty, belongs to another
+// position, or was torn by concurrent writes
+static inline bool read_entry(Cluster *cluster, int index, uint16_t key,
+                              Transposition *entry) {
+    U64 data = load_data(&cluster->data[index]);
+    uint16_t stored_key = cluster->keys[index];
+
+    entry->move = data;
+    entry->score = (int16_t)(data >> 16);
+    entry->eval = (int16_t)(data >> 32);
+    entry->depth = data >> 48;
+    entry->flag = data >> 56;
+
+    return (entry->flag & BOUND_MASK) &&
+           (uint16_t)(stored_key ^ data ^ data >> 16 ^ data >> 32 ^
+                      data >> 48) == key;
+}
+
+// Pack an entry into its data word and key
+static inline void write_entry(Cluster *cluster, int index, uint16_t key,
+                               const Transposition *entry) {
+    U64 data = (U64)entry->move | (U64)(uint16_t)entry->score << 16 |
+               (U64)(uint16_t)entry->eval << 32 | (U64)entry->depth << 48 |
+               (U64)entry->flag << 56;
+
+    store_data(&cluster->data[index], data);
+    cluster->keys[index] = key ^ data ^ data >> 16 ^ data >> 32 ^ data >> 48;
+}
+
+// Read and write data words in one access, which the key check relies on
+static inline U64 load_data(const U64 *data) {
+#if defined(__GNUC__)
+    return __atomic_load_n(data, __ATOMIC_RELAXED);
+#else
+    return *(volatile const U64 *)data;
+#endif
+}
+
+static inline void store_data(U64 *data, U64 value) {
+#if defined(__GNUC__)
+    __atomic_store_n(data, value, __ATOMIC_RELAXED);
+#else
+    *(volatile U64 *)data = value;
+#endif
+}
+
+// Find entry of a position in its cluster and refresh its generation
+static inline bool find_entry(U64 hash, Transposition *entry) {
+    Cluster *cluster = get_cluster(hash);
+    uint16_t key = get_key(hash);
+
+    for (int i = 0; i < CLUSTER_SIZE; i++) {
+        if (read_entry(cluster, i, key, entry)) {
+            if ((entry->flag & ~BOUND_MASK) != generation) {
+                entry->flag = generation | (entry->flag & BOUND_MASK);
+                write_entry(cluster, i, key, entry);
+            }
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Get index of the entry to store a position in, which is the entry of the
+// same position or an empty entry if there is one, otherwise the entry with
+// the lowest depth where every search since it was stored counts as lost
+// depth. The old content of the entry is copied.
+static inline int replace_entry(U64 hash, Transposition *entry, bool *same) {
+    Cluster *cluster = get_cluster(hash);
+    Transposition replace = {0};
+    uint16_t key = get_key(hash);
+    int index = 0;
+
+    for (int i = 0; i < CLUSTER_SIZE; i++) {
+        *same = read_entry(cluster, i, key, entry);
+        if (*same || !(entry->flag & BOUND_MASK)) {
+            return i;
+        }
+
+        if (i == 0 || entry->depth - AGE_WEIGHT * get_age(entry->flag) <
+                          replace.depth - AGE_WEIGHT * get_age(replace.flag)) {
+            replace = *entry;
+            index = i;
+        }
+    }
+
+    *entry = replace;
+    return index;
+}
+
+// Get number of searches since entry was stored or found
+static inline int get_age(int flag) {
+    return (uint8_t)(generation - (flag & ~BOUND_MASK)) / GENERATION_DELTA;
 }
 
 // Display the principal variation from tranposition table
 static void print_pv_moves(Board *board) {
-    U64 hash = board->hash;
-    Transposition *entry = &transposition[hash & (transposition_size - 1)];
+    Transposition entry;
 
-    if (entry->hash == hash && entry->flag == EXACT_BOUND) {
-        Move move = entry->move;
+    if (find_entry(board->hash, &entry) &&
+        (entry.flag & BOUND_MASK) == EXACT_BOUND) {
+        Move move = entry.move;
         printf(" %s%s", get_coordinates(get_move_start(move)),
                get_coordinates(get_move_end(move)));
 
-        if (entry->depth != 1) {
+        if (entry.depth != 1) {
             make_move(board, move);
             print_pv_moves(board);
             unmake_move(board, move);
@@ -204,15 +735,20 @@ static void print_pv_moves(Board *board) {
     }
 }
 
-// Approximate how full the transposition table is in permill
+// Approximate how full the transposition table is in permill, counting only
+// entries stored or found in the current search
 int get_hashfull() {
-    int count = 0;
-
-    for (int i = 0; i < 65536; i++) {
-        if (transposition[i].hash) {
-            count++;
+    // Loaded hash files may have fewer clusters than are sampled
+    int samples = (int)MIN(1000, cluster_count), count = 0;
+
+    for (int i = 0; i < samples; i++) {
+        for (int j = 0; j < CLUSTER_SIZE; j++) {
+            int flag = load_data(&clusters[i].data[j]) >> 56;
+            if ((flag & BOUND_MASK) && (flag & ~BOUND_MASK) == generation) {
+                count++;
+            }
         }
     }
 
-    return (count * 1000) >> 16;
+    return count * 1000 / (samples * CLUSTER_SIZE);
 }
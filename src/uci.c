@@ -4,7 +4,10 @@
 #include "board.h"
 #include "evaluation.h"
 #include "move.h"
+#include "proof_search.h"
 #include "search.h"
+#include "tablebase.h"
+#include "time_manager.h"
 #include "transposition.h"
 
 typedef struct argument {
@@ -15,6 +18,7 @@ typedef struct argument {
 typedef struct node {
     void (*function)(char *, Board *);
     char *input;
+    bool stop;
     struct node *next;
 } Node;
 
@@ -23,22 +27,31 @@ typedef struct queue {
     Node *tail;
 } Queue;
 
+// Queue of commands that run after the current search, the mutex guards it
+// and the idle flag between the UCI loop and the search thread
 static Queue queue;
+static pthread_mutex_t queue_mutex = PTHREAD_MUTEX_INITIALIZER;
 static pthread_t old_tid, search_tid;
 static bool idle = true;
+static char hash_file[4096];
 
 static inline char *parse_input();
 static inline void parse_option(char *option, __UNUSED__ Board *board);
 static inline void parse_position(char *option, Board *board);
 static inline void parse_go(char *option, Board *board);
 static inline Move parse_move(char *move, Board *board);
+static inline void new_game(__UNUSED__ char *input, __UNUSED__ Board *board);
+static inline void save_hash(char *input, __UNUSED__ Board *board);
+static inline void load_hash(char *input, __UNUSED__ Board *board);
 static inline void trim_whitespace(char **input);
 static inline void lowercase(char *input);
 
 static void *init_all(void *board);
 static void *search_thread(void *argument);
-static void *sleep_thread(void *time);
 
+static inline void run_command(void (*function)(char *, Board *),
+                               char *input, Board *board);
+static inline void stop_queue();
 static inline void enqueue(void (*function)(char *, Board *), char *input);
 static inline Node *dequeue();
 
@@ -70,8 +83,6 @@ void start_uci() {
             continue;
         }
 
-        // TODO: implement "debug" and "ponderhit"
-
         // Commands to run instantly
         if (!strcmp(token, "uci")) {
             printf("id name Chess %s\n", VERSION);
@@ -79,6 +90,19 @@ void start_uci() {
 
             printf("option name Hash"
                    " type spin default 512 min 1 max 1073741824\n");
+            printf("option name Threads"
+                   " type spin default 1 min 1 max 256\n");
+            printf("option name Move Overhead"
+                   " type spin default 10 min 0 max 5000\n");
+            printf("option name Ponder type check default false\n");
+            printf("option name MultiPV"
+                   " type spin default 1 min 1 max 256\n");
+            printf("option name Proof Search type check default false\n");
+            printf("option name Tablebase Path"
+                   " type string default <empty>\n");
+            printf("option name Hash File type string default <empty>\n");
+            printf("option name Save Hash type button\n");
+            printf("option name Load Hash type button\n");
 
             printf("\nuciok\n");
         } else if (!strcmp(token, "isready")) {
@@ -87,44 +111,58 @@ void start_uci() {
                 init_tid = 0;
             }
             printf("readyok\n");
+        } else if (!strcmp(token, "debug")) {
+            token = strtok_r(token_ptr, " \t", &token_ptr);
+            debug_mode = token && !strcmp(token, "on");
+        } else if (!strcmp(token, "ponderhit")) {
+            ponder_hit();
         } else if (!strcmp(token, "stop")) {
-            time_over = true;
+            stop_search();
+            stop_proof_search();
+            stop_queue();
         } else if (!strcmp(token, "quit")) {
+            stop_search();
+            stop_proof_search();
+            stop_queue();
             free(input);
             break;
         }
 
         // Commands to run after current search is finished
         else if (!strcmp(token, "setoption")) {
-            if (idle) {
-                parse_option(token_ptr, NULL);
-            } else {
-                enqueue(parse_option, token_ptr);
+            if (init_tid) {
+                pthread_join(init_tid, NULL);
+                init_tid = 0;
             }
+
+            run_command(parse_option, token_ptr, &board);
         } else if (!strcmp(token, "ucinewgame")) {
-            if (idle) {
-                clear_transposition();
-            } else {
-                enqueue(clear_transposition, token_ptr);
+            run_command(new_game, token_ptr, &board);
+        } else if (!strcmp(token, "savehash") ||
+                   !strcmp(token, "loadhash")) {
+            void (*function)(char *, Board *) =
+                !strcmp(token, "savehash") ? save_hash : load_hash;
+
+            if (init_tid) {
+                pthread_join(init_tid, NULL);
+                init_tid = 0;
             }
+
+            run_command(function, token_ptr, &board);
         } else if (!strcmp(token, "position")) {
-            if (idle) {
-                parse_position(token_ptr, &board);
-            } else {
-                enqueue(parse_position, token_ptr);
+            if (init_tid) {
+                pthread_join(init_tid, NULL);
+                init_tid = 0;
             }
+
+            run_command(parse_position, token_ptr, &board);
         } else if (!strcmp(token, "go")) {
             if (init_tid) {
                 pthread_join(init_tid, NULL);
                 init_tid = 0;
             }
 
-            if (idle) {
-                idle = false;
-                parse_go(token_ptr, &board);
-            } else {
-                enqueue(parse_go, token_ptr);
-            }
+            run_command(parse_go, token_ptr, &board);
         }
 
         // Debug commands (not part of UCI)
@@ -136,6 +174,39 @@ void start_uci() {
             } else {
                 benchmark(&board, 6);
             }
+        } else if (!strcmp(token, "bench")) {
+            if (init_tid) {
+                pthread_join(init_tid, NULL);
+                init_tid = 0;
+            }
+
+            if ((token = strtok_r(token_ptr, " \t", &token_ptr))) {
+                search_benchmark(atoi(token));
+            } else {
+                search_benchmark(8);
+            }
+        } else if (!strcmp(token, "tt")) {
+            if (init_tid) {
+                pthread_join(init_tid, NULL);
+                init_tid = 0;
+            }
+
+            token = strtok_r(token_ptr, " \t", &token_ptr);
+            if (token && !strcmp(token, "stats")) {
+                print_tt_stats();
+            }
+        } else if (!strcmp(token, "tbgen")) {
+            if (init_tid) {
+                pthread_join(init_tid, NULL);
+                init_tid = 0;
+            }
+
+            char *path = strtok_r(token_ptr, " \t", &token_ptr);
+            if (path && (token = strtok_r(token_ptr, " \t", &token_ptr))) {
+                generate_tablebases(path, atoi(token));
+            } else if (path) {
+                generate_tablebases(path, TABLEBASE_PIECES);
+            }
         }
 
         free(input);
@@ -148,7 +219,10 @@ void start_uci() {
     if (search_tid) {
         pthread_join(search_tid, NULL);
     }
+    free_threads();
     free_transposition();
+    free_proof_search();
+    free_tablebases();
 }
 
 // Parse input from stdin into a buffer
@@ -186,7 +260,20 @@ static inline void parse_option(char *option, __UNUSED__ Board *board) {
     char *value = strstr(option, " value ");
 
     // Check that input is valid
-    if (!token || strcmp(token, "name") || !value) {
+    if (!token || strcmp(token, "name")) {
+        return;
+    }
+
+    // Buttons have no value
+    if (!value) {
+        trim_whitespace(&option);
+        lowercase(option);
+
+        if (!strcmp(option, "save hash")) {
+            save_hash(hash_file, board);
+        } else if (!strcmp(option, "load hash")) {
+            load_hash(hash_file, board);
+        }
         return;
     }
     value[0] = '\0';
@@ -195,10 +282,27 @@ static inline void parse_option(char *option, __UNUSED__ Board *board) {
     trim_whitespace(&option);
     trim_whitespace(&value);
     lowercase(option);
+
+    // Paths are case sensitive
+    if (!strcmp(option, "tablebase path")) {
+        init_tablebases(value);
+        return;
+    } else if (!strcmp(option, "hash file")) {
+        snprintf(hash_file, sizeof(hash_file), "%s", value);
+        return;
+    }
     lowercase(value);
 
     if (!strcmp(option, "hash")) {
         init_transposition(atoi(value));
+    } else if (!strcmp(option, "threads")) {
+        init_threads(atoi(value));
+    } else if (!strcmp(option, "multipv")) {
+        multi_pv = MIN(MAX(atoi(value), 1), MAX_MOVES);
+    } else if (!strcmp(option, "move overhead")) {
+        move_overhead = MAX(atoi(value), 0);
+    } else if (!strcmp(option, "proof search")) {
+        use_proof_search = !strcmp(value, "true");
     }
 }
 
@@ -317,7 +421,7 @@ static inline void parse_go(char *input, Board *board) {
             if (!(token = strtok_r(input, " \t", &input))) {
                 break;
             }
-            parameters.max_nodes = atoi(token);
+            parameters.max_nodes = strtoull(token, NULL, 10);
         } else if (!strcmp(token, "mate")) {
             if (!(token = strtok_r(input, " \t", &input))) {
                 break;
@@ -333,22 +437,45 @@ static inline void parse_go(char *input, Board *board) {
         }
     }
 
-    // Set infinite search if no time controls are set
-    if (parameters.white_time == 0 && parameters.black_time == 0 &&
-        parameters.move_time) {
-        parameters.infinite = true;
-    }
+    // Set before the search starts so that an early ponderhit is not lost
+    set_pondering(parameters.ponder);
 
     if (search_tid) {
         old_tid = search_tid;
         search_tid = 0;
     }
 
+    // Reset before the search starts so that an early stop is not lost
+    reset_search();
+    reset_proof_search();
+
     static Argument argument;
     argument = (Argument){board, parameters};
     pthread_create(&search_tid, NULL, search_thread, &argument);
 }
 
+// Clear data from previous games
+static inline void new_game(__UNUSED__ char *input, __UNUSED__ Board *board) {
+    clear_transposition();
+    clear_search();
+}
+
+// Save transposition table to a file
+static inline void save_hash(char *input, __UNUSED__ Board *board) {
+    trim_whitespace(&input);
+    if (*input && save_transposition(input)) {
+        printf("info string hash saved to %s\n", input);
+    }
+}
+
+// Load transposition table from a file
+static inline void load_hash(char *input, __UNUSED__ Board *board) {
+    trim_whitespace(&input);
+    if (*input && load_transposition(input)) {
+        printf("info string hash loaded from %s\n", input);
+    }
+}
+
 // Parse move from UCI command and return move
 static inline Move parse_move(char *move, Board *board) {
     size_t length = strlen(move);
@@ -428,7 +555,10 @@ static void *init_all(void *board) {
     init_attacks();
     init_board(board);
     init_evaluation();
+    init_search();
+    init_hash_keys();
     init_transposition(512);
+    init_threads(1);
     load_fen(board, START_FEN);
 
     return NULL;
@@ -444,26 +574,33 @@ static void *search_thread(void *argument) {
         pthread_join(old_tid, NULL);
     }
 
-    pthread_t clock_tid = 0;
-    if (parameters.move_time) {
-        pthread_create(&clock_tid, NULL, sleep_thread, &parameters.move_time);
-    }
-
-    start_search(board, parameters);
-
-    if (clock_tid) {
-        pthread_join(clock_tid, NULL);
+    // Mate searches use proof numbers and fall back to alpha-beta when no
+    // mate within the limit exists
+    bool done = (parameters.mate || use_proof_search) &&
+                start_proof_search(board, parameters);
+    if (!done) {
+        if (parameters.mate && !parameters.max_depth) {
+            parameters.max_depth = MIN(2 * parameters.mate, MAX_DEPTH);
+        }
+        start_search(board, parameters);
     }
 
     // Run commands in queue
     Node *node;
     bool next_search = false;
+    pthread_mutex_lock(&queue_mutex);
     while ((node = dequeue())) {
         if (node->function == parse_go) {
             next_search = true;
         }
 
         node->function(node->input, board);
+
+        // Stop sent while the search was queued
+        if (node->stop) {
+            stop_search();
+            stop_proof_search();
+        }
         free(node->input);
         free(node);
 
@@ -475,21 +612,31 @@ static void *search_thread(void *argument) {
     if (!next_search) {
         idle = true;
     }
+    pthread_mutex_unlock(&queue_mutex);
 
     return NULL;
 }
 
-// Sleep for a given number of milliseconds
-static void *sleep_thread(void *time) {
-    int milliseconds = *(int *)time;
-    struct timespec ts = {
-        .tv_sec = milliseconds / 1000,
-        .tv_nsec = (milliseconds % 1000) * 1000000,
-    };
-    nanosleep(&ts, NULL);
-    time_over = true;
+// Run command now if no search is running, otherwise after the search
+static inline void run_command(void (*function)(char *, Board *),
+                               char *input, Board *board) {
+    pthread_mutex_lock(&queue_mutex);
+    if (idle) {
+        idle = function != parse_go;
+        function(input, board);
+    } else {
+        enqueue(function, input);
+    }
+    pthread_mutex_unlock(&queue_mutex);
+}
 
-    return NULL;
+// Stop the searches in the queue as well, since they were sent before stop
+static inline void stop_queue() {
+    pthread_mutex_lock(&queue_mutex);
+    for (Node *node = queue.head; node; node = node->next) {
+        node->stop = node->function == parse_go;
+    }
+    pthread_mutex_unlock(&queue_mutex);
 }
 
 // Add a new function to the end of the queue
@@ -498,6 +645,7 @@ static inline void enqueue(void (*function)(char *, Board *), char *input) {
 
     node->function = function;
     node->input = malloc(strlen(input) + 1);
+    node->stop = false;
     node->next = NULL;
 
     strcpy(node->input, input);
@@ -0,0 +1,79 @@
+#include "attacks.h"
+#include "board.h"
+#include "proof_search.h"
+#include "transposition.h"
+
+#define TEST_POSITIONS 6
+
+// Positions with the number of moves of the shortest mate, or no mate
+// within the limit if the number is negative
+static const char *positions[TEST_POSITIONS] = {
+    "6k1/5ppp/8/8/8/8/5PPP/3R2K1 w - - 0 1",
+    "kbK5/pp6/1P6/8/8/8/8/R7 w - - 0 1",
+    "r5rk/5p1p/5R2/4B3/8/8/7P/7K w - - 0 1",
+    "2r3k1/p4p2/3Rp2p/1p2P1pK/8/1P4P1/P3Q2P/1q6 b - - 0 1",
+    "8/8/8/4k3/8/8/8/4K2R w K - 0 1",
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1"};
+
+static const int mates[TEST_POSITIONS] = {1, 2, 3, 3, -4, -2};
+
+// Search for a mate with the output written to a file, and get the length
+// of the principal variation of the last info line
+static bool search_mate(const char *fen, int mate, int *length) {
+    Board board;
+    Parameter parameters = {0};
+    char line[4096];
+    FILE *file = tmpfile();
+    int saved = dup(STDOUT_FILENO);
+
+    if (!file || saved < 0 || !load_fen(&board, fen)) {
+        return false;
+    }
+    parameters.start_time = get_time();
+    parameters.mate = mate;
+
+    fflush(stdout);
+    dup2(fileno(file), STDOUT_FILENO);
+    reset_proof_search();
+    bool proven = start_proof_search(&board, parameters);
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+
+    *length = 0;
+    rewind(file);
+    while (fgets(line, sizeof(line), file)) {
+        char *pv = strstr(line, " pv ");
+        if (!strncmp(line, "info", 4) && pv) {
+            *length = 0;
+            for (char *token = strtok(pv + 4, " \n"); token;
+                 token = strtok(NULL, " \n")) {
+                (*length)++;
+            }
+        }
+    }
+    fclose(file);
+
+    return proven;
+}
+
+int main() {
+    init_attacks();
+    init_hash_keys();
+
+    for (int i = 0; i < TEST_POSITIONS; i++) {
+        int length, mate = abs(mates[i]);
+        bool proven = search_mate(positions[i], mate, &length);
+
+        // A proof plays the mate, otherwise no best move is sent so that
+        // the normal search can run
+        if (proven != (mates[i] > 0) ||
+            (proven && length != 2 * mate - 1)) {
+            printf("proof search: %s %d %d\n", positions[i], proven, length);
+            return 1;
+        }
+    }
+
+    free_proof_search();
+    return 0;
+}
@@ -0,0 +1,125 @@
+#include <dirent.h>
+
+#include "attacks.h"
+#include "board.h"
+#include "tablebase.h"
+#include "transposition.h"
+
+#define TEST_POSITIONS 4
+
+// Positions with their win/draw/loss value and mate score: a rook pawn
+// draw, a pawn win, a mate with colors flipped, and a stalemate
+static const char *positions[TEST_POSITIONS] = {
+    "k7/8/8/8/8/8/P7/K7 w - - 0 1", "4k3/8/4K3/4P3/8/8/8/8 b - - 0 1",
+    "8/8/8/8/8/2k5/8/K1q5 w - - 0 1", "8/8/8/8/8/8/1R6/k1K5 b - - 0 1"};
+
+static const int wdls[TEST_POSITIONS] = {WDL_DRAW, WDL_LOSS, WDL_LOSS,
+                                         WDL_DRAW};
+static const int scores[TEST_POSITIONS] = {DRAW_SCORE, -INFINITY + 24,
+                                           -INFINITY + 2, DRAW_SCORE};
+
+// Get the longest mate of the stronger side to move over all placements of
+// the kings and a white piece
+static int get_longest_mate(char piece) {
+    int longest = 0;
+
+    for (int squares = 0; squares < 64 * 64 * 64; squares++) {
+        int king = squares & 63, enemy = squares >> 6 & 63;
+        int square = squares >> 12, length = 0, score;
+        char grid[64], fen[128];
+        Board board;
+
+        if (king == enemy || king == square || enemy == square) {
+            continue;
+        }
+
+        memset(grid, 0, sizeof(grid));
+        grid[king] = 'K';
+        grid[enemy] = 'k';
+        grid[square] = piece;
+
+        for (int rank = 7; rank >= 0; rank--) {
+            int empty = 0;
+            for (int file = 0; file < 8; file++) {
+                char symbol = grid[rank * 8 + file];
+                if (!symbol) {
+                    empty++;
+                    continue;
+                }
+                if (empty) {
+                    fen[length++] = '0' + empty;
+                    empty = 0;
+                }
+                fen[length++] = symbol;
+            }
+            if (empty) {
+                fen[length++] = '0' + empty;
+            }
+            fen[length++] = rank ? '/' : ' ';
+        }
+        strcpy(fen + length, "w - - 0 1");
+
+        if (load_fen(&board, fen) && probe_dtm(&board, &score) &&
+            score > DRAW_SCORE) {
+            longest = MAX(longest, INFINITY - score);
+        }
+    }
+
+    return longest;
+}
+
+// Remove the generated tables and their directory
+static void remove_tables(const char *path) {
+    char file[4096];
+    DIR *directory = opendir(path);
+    struct dirent *entry;
+
+    while (directory && (entry = readdir(directory))) {
+        if (entry->d_name[0] != '.') {
+            snprintf(file, sizeof(file), "%s/%s", path, entry->d_name);
+            remove(file);
+        }
+    }
+    if (directory) {
+        closedir(directory);
+    }
+    rmdir(path);
+}
+
+int main() {
+    char path[] = "/tmp/tablebaseXXXXXX";
+    bool failed = false;
+
+    init_attacks();
+    init_hash_keys();
+
+    if (!mkdtemp(path)) {
+        return 1;
+    }
+    generate_tablebases(path, 3);
+    free_tablebases();
+    init_tablebases(path);
+
+    for (int i = 0; i < TEST_POSITIONS; i++) {
+        Board board;
+        int wdl, score;
+
+        if (!load_fen(&board, positions[i]) || !probe_wdl(&board, &wdl) ||
+            !probe_dtm(&board, &score) || wdl != wdls[i] ||
+            score != scores[i]) {
+            printf("tablebase: %s\n", positions[i]);
+            failed = true;
+        }
+    }
+
+    // Longest mates are 10 moves with a queen and 16 moves with a rook
+    if (get_longest_mate('Q') != 19 || get_longest_mate('R') != 31) {
+        printf("tablebase: longest mate %d %d\n", get_longest_mate('Q'),
+               get_longest_mate('R'));
+        failed = true;
+    }
+
+    free_tablebases();
+    remove_tables(path);
+    return failed;
+}
@@ -1,6 +1,9 @@
 #include "attacks.h"
 #include "benchmark.h"
 #include "board.h"
+#include "move.h"
+#include "move_generation.h"
+#include "transposition.h"
 
 #define TEST_POSITIONS 6
 #define TEST_DEPTH 5
@@ -19,6 +22,59 @@ static const U64 perft_results[TEST_POSITIONS][TEST_DEPTH] = {
     {44, 1486, 62379, 2103487, 89941194}, {46, 2079, 89890, 3894594, 164075551},
 };
 
+// Check staged move generation and pseudo legality against generate_moves
+static bool check_generation(Board *board, int depth, Move *old_moves,
+                             int old_count, Move *parent_moves,
+                             int parent_count) {
+    Move moves[MAX_MOVES], staged_moves[MAX_MOVES];
+    int count = generate_moves(board, moves);
+    int staged_count = generate_captures(board, staged_moves);
+    staged_count += generate_quiets(board, staged_moves + staged_count);
+
+    if (count != staged_count) {
+        printf("staged generation: %d %d\n", count, staged_count);
+        return false;
+    }
+
+    // Moves from previous positions are pseudo legal only if generated
+    for (int i = 0; i < old_count + parent_count; i++) {
+        Move move = i < old_count ? old_moves[i] : parent_moves[i - old_count];
+        bool generated = false;
+
+        for (int j = 0; j < count; j++) {
+            generated |= moves[j] == move;
+        }
+        if (move_pseudo_legal(board, move) != generated) {
+            printf("pseudo legal: %04x\n", move);
+            return false;
+        }
+    }
+
+    if (depth == 0) {
+        return true;
+    }
+
+    for (int i = 0; i < count; i++) {
+        U64 key = key_after(board, moves[i]);
+        make_move(board, moves[i]);
+        if (board->hash != key || board->hash != get_hash(board)) {
+            printf("key after: %04x\n", moves[i]);
+            unmake_move(board, moves[i]);
+            return false;
+        }
+        bool valid = in_check(board, !board->player) ||
+                     check_generation(board, depth - 1, parent_moves,
+                                      parent_count, moves, count);
+        unmake_move(board, moves[i]);
+
+        if (!valid) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
 int main(int argc, char **argv) {
     Board board;
     U64 nodes;
@@ -31,6 +87,7 @@ int main(int argc, char **argv) {
     }
 
     init_attacks();
+    init_hash_keys();
 
     load_fen(&board, positions[position]);
     for (int depth = 1; depth <= TEST_DEPTH; depth++) {
@@ -42,5 +99,9 @@ int main(int argc, char **argv) {
         }
     }
 
+    if (!check_generation(&board, 3, NULL, 0, NULL, 0)) {
+        return 1;
+    }
+
     return 0;
 }
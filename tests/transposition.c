@@ -0,0 +1,223 @@
+#include <pthread.h>
+#include <stdio.h>
+
+#include "transposition.h"
+
+#define THREADS 8
+#define POSITIONS 4096
+#define CLUSTERS 16
+#define ITERATIONS 2000000
+#define SAVED_POSITIONS 1000
+
+static volatile bool failed;
+static U64 hits[THREADS];
+
+// Mix bits of a number into a pseudo random hash
+static U64 mix(U64 x) {
+    x += UINT64_C(0x9E3779B97F4A7C15);
+    x = (x ^ (x >> 30)) * UINT64_C(0xBF58476D1CE4E5B9);
+    x = (x ^ (x >> 27)) * UINT64_C(0x94D049BB133111EB);
+    return x ^ (x >> 31);
+}
+
+// Positions share a few clusters so that threads write the same entries,
+// the upper bits select the cluster and the lower 16 bits are the key
+static U64 get_position(int index) {
+    return (U64)(index % CLUSTERS) << 60 |
+           (mix(index) & UINT64_C(0x0000FFFFFFFF0000)) | index;
+}
+
+// Store an entry whose content is a function of its hash
+static void store_position(U64 hash, TTStats *stats) {
+    U64 data = mix(hash);
+
+    set_transposition(hash, (int)(data & 0x7FF) - 1024,
+                      (int)(data >> 12 & 0x7FF) - 1024, 1 + (data >> 24) % 3,
+                      0, 1 + (data >> 32) % 64, (data >> 48) | 1, stats);
+}
+
+// Check that a probed entry has the content stored for its hash
+static bool check_position(U64 hash, const Transposition *entry) {
+    U64 data = mix(hash);
+
+    return entry->score == (int)(data & 0x7FF) - 1024 &&
+           entry->eval == (int)(data >> 12 & 0x7FF) - 1024 &&
+           entry->flag == 1 + (data >> 24) % 3 &&
+           entry->depth == 1 + (data >> 32) % 64 &&
+           entry->move == ((data >> 48) | 1);
+}
+
+// Store and probe entries whose content is a function of their hash, and
+// check that no probe returns the content of another position
+static void *stress(void *argument) {
+    U64 random = mix((uintptr_t)argument);
+    TTStats stats = {0};
+
+    for (int i = 0; i < ITERATIONS && !failed; i++) {
+        U64 hash = get_position((random = mix(random)) % POSITIONS);
+        Transposition entry;
+
+        if (random >> 63) {
+            store_position(hash, &stats);
+        } else if (probe_transposition(hash, 0, &entry)) {
+            stats.hits++;
+            if (!check_position(hash, &entry)) {
+                printf("corrupted entry: %016llx\n", hash);
+                failed = true;
+            }
+        }
+    }
+
+    hits[(uintptr_t)argument] = stats.hits;
+    return NULL;
+}
+
+// Run threads that store and probe the same entries
+static void test_stress() {
+    pthread_t threads[THREADS];
+    U64 total_hits = 0;
+
+    init_transposition(1);
+    clear_transposition();
+    age_transposition();
+
+    for (int i = 0; i < THREADS; i++) {
+        pthread_create(&threads[i], NULL, stress, (void *)(uintptr_t)i);
+    }
+
+    for (int i = 0; i < THREADS; i++) {
+        pthread_join(threads[i], NULL);
+        total_hits += hits[i];
+    }
+
+    // Without hits no entry was checked, so the test would pass vacuously
+    if (!total_hits) {
+        printf("no transposition hits\n");
+        failed = true;
+    }
+}
+
+// Count the stored entries that are found with their content
+static int count_positions(const bool *stored) {
+    int count = 0;
+
+    for (int i = 0; i < SAVED_POSITIONS; i++) {
+        Transposition entry;
+
+        if (stored[i] && probe_transposition(mix(i), 0, &entry) &&
+            check_position(mix(i), &entry)) {
+            count++;
+        }
+    }
+    return count;
+}
+
+// Write a buffer to a file
+static bool write_file(const char *path, const char *buffer, long size) {
+    FILE *file = fopen(path, "wb");
+    bool written = file && fwrite(buffer, 1, size, file) == (size_t)size;
+
+    return file && !fclose(file) && written;
+}
+
+// Save a table and load it in place of a table of another size, then check
+// that the same entries are found. Files with a wrong magic, hash keys, or
+// size are rejected and leave the loaded table as it is.
+static void test_hash_file() {
+    char path[] = "/tmp/hashXXXXXX";
+    bool stored[SAVED_POSITIONS];
+    TTStats stats = {0};
+    int count = 0, descriptor = mkstemp(path);
+
+    init_transposition(2);
+    clear_transposition();
+    age_transposition();
+
+    for (int i = 0; i < SAVED_POSITIONS; i++) {
+        store_position(mix(i), &stats);
+    }
+
+    // Entries can replace each other, so only the ones found are expected
+    for (int i = 0; i < SAVED_POSITIONS; i++) {
+        Transposition entry;
+
+        stored[i] = probe_transposition(mix(i), 0, &entry);
+        count += stored[i];
+    }
+
+    if (descriptor < 0 || close(descriptor) || !count ||
+        !save_transposition(path)) {
+        printf("hash file failed to save\n");
+        failed = true;
+        return;
+    }
+
+    init_transposition(3);
+    clear_transposition();
+    if (!load_transposition(path) || count_positions(stored) != count) {
+        printf("hash file entries differ after loading\n");
+        failed = true;
+    }
+
+    // Read the saved file to write broken copies of it
+    FILE *file = fopen(path, "rb");
+    long size = -1;
+    if (file && !fseek(file, 0, SEEK_END)) {
+        size = ftell(file);
+        rewind(file);
+    }
+
+    char *buffer = size > 0 ? malloc(size) : NULL;
+    if (!buffer || fread(buffer, 1, size, file) != (size_t)size) {
+        printf("hash file failed to read\n");
+        failed = true;
+        free(buffer);
+        buffer = NULL;
+    }
+    if (file) {
+        fclose(file);
+    }
+
+    // Change the magic or the key seed, or cut off the last byte
+    for (int i = 0; buffer && i < 3; i++) {
+        int offset = i == 0 ? 0 : 8;
+
+        if (i < 2) {
+            buffer[offset] ^= 1;
+        }
+        bool written = write_file(path, buffer, i < 2 ? size : size - 1);
+        if (i < 2) {
+            buffer[offset] ^= 1;
+        }
+
+        if (!written || load_transposition(path) ||
+            count_positions(stored) != count) {
+            printf("broken hash file %d was loaded\n", i);
+            failed = true;
+        }
+    }
+
+    // A valid file with fewer clusters than hashfull samples, the header
+    // is 64 bytes with the cluster count after the magic and the key seed
+    U64 small_count = 10;
+    if (buffer) {
+        memcpy(buffer + 16, &small_count, sizeof(small_count));
+    }
+    if (buffer && (!write_file(path, buffer, 64 + small_count * 64) ||
+                   !load_transposition(path) || get_hashfull() < 0 ||
+                   get_hashfull() > 1000)) {
+        printf("small hash file failed\n");
+        failed = true;
+    }
+
+    free(buffer);
+    remove(path);
+}
+
+int main() {
+    test_stress();
+    test_hash_file();
+
+    free_transposition();
+    return failed;
+}
@@ -0,0 +1,87 @@
+#include <poll.h>
+
+#include "uci.h"
+
+#define TIMEOUT 10000
+
+static const char *commands[] = {
+    // Debug commands sent before initialization is done must wait for it
+    "tt stats\nposition startpos\ngo depth 1\n",
+    // Stop right after go must not be lost, even while pondering
+    "position startpos\ngo ponder wtime 1000 btime 1000\nstop\n",
+    "position startpos moves e2e4\ngo wtime 1000 btime 1000\nstop\n",
+    "position startpos\ngo infinite\nstop\n",
+    "position startpos\ngo mate 5\nstop\n",
+    "setoption name Proof Search value true\n"
+    "position fen 6k1/5ppp/8/8/8/8/5PPP/3R2K1 w - - 0 1\n"
+    "go ponder wtime 1000 btime 1000\nstop\n",
+};
+
+static int input[2], output[2];
+
+// Run the engine with its standard input and output redirected to pipes
+static void *run_uci(__UNUSED__ void *argument) {
+    start_uci();
+    return NULL;
+}
+
+// Wait until the engine sends a best move or the timeout is reached
+static bool wait_bestmove() {
+    static char buffer[1 << 16];
+    static size_t length = 0, checked = 0;
+    struct pollfd descriptor = {output[0], POLLIN, 0};
+    U64 start_time = get_time();
+
+    while (get_time() - start_time < TIMEOUT) {
+        char *found = strstr(buffer + checked, "bestmove");
+        if (found) {
+            checked = found - buffer + 1;
+            return true;
+        }
+
+        // Drop output that was already checked when the buffer is full
+        if (length == sizeof(buffer) - 1) {
+            memmove(buffer, buffer + checked, length - checked);
+            length -= checked;
+            checked = 0;
+        }
+
+        if (poll(&descriptor, 1, 100) > 0) {
+            ssize_t count = read(output[0], buffer + length,
+                                 sizeof(buffer) - 1 - length);
+            if (count <= 0) {
+                return false;
+            }
+            length += count;
+            buffer[length] = '\0';
+        }
+    }
+
+    return false;
+}
+
+int main() {
+    pthread_t tid;
+    int count = sizeof(commands) / sizeof(commands[0]);
+
+    if (pipe(input) || pipe(output) || dup2(input[0], STDIN_FILENO) < 0 ||
+        dup2(output[1], STDOUT_FILENO) < 0) {
+        return 1;
+    }
+    pthread_create(&tid, NULL, run_uci, NULL);
+
+    for (int i = 0; i < count; i++) {
+        if (write(input[1], commands[i], strlen(commands[i])) < 0 ||
+            !wait_bestmove()) {
+            fprintf(stderr, "no bestmove after: %s", commands[i]);
+            return 1;
+        }
+    }
+
+    if (write(input[1], "quit\n", 5) < 0) {
+        return 1;
+    }
+    pthread_join(tid, NULL);
+
+    return 0;
+}